@@ -1,48 +1,197 @@
 #ifndef APU_H
 #define APU_H
 
+#include "mem.h"
+#include "audio/blip_buffer.h"
+#include "save_state.h"
 #include <cstdint>
 #include <array>
+#include <limits>
+
+constexpr uint64_t APU_NO_EVENT = std::numeric_limits<uint64_t>::max();
+
+// Channels are not clocked every cycle. The APU runs lazily up to a CPU
+// cycle, jumping straight from one timer reload or frame event to the next.
+// Each channel exposes next_event() (APU_NO_EVENT while its output cannot
+// change) and advance_to(), which catches its timer up to a cycle.
+
+class Envelope {
+public:
+    bool start;
+    bool loop;              // doubles as the length counter halt flag
+    bool constant_volume;
+    uint8_t volume;         // constant volume, or the decay divider period
+    uint8_t divider;
+    uint8_t decay;
+
+    Envelope();
+    void write(uint8_t value);
+    void clock();
+    uint8_t output() const { return constant_volume ? volume : decay; }
+};
 
 class PulseChannel {
 public:
     uint8_t duty_cycle;        
-    bool length_counter_halt;  
-    bool constant_volume;
-    uint8_t volume;           
+    Envelope envelope;
     bool sweep_enabled;
     uint8_t sweep_period;
     bool sweep_negate;
     uint8_t sweep_shift;
+    uint8_t sweep_divider;
+    bool sweep_reload;
     uint16_t timer_period;    
-    uint16_t timer_value;
+    uint64_t next_clock;      // CPU cycle of the next timer reload
     uint8_t length_counter;
     bool enabled;
     uint8_t duty_sequence;    
-    uint8_t envelope_divider;
-    uint8_t envelope_counter;
-    bool envelope_start;
     
     PulseChannel();
     void write_register(uint8_t reg, uint8_t value); 
-    float output();  
-    void clock_timer();
+    uint8_t output() const;
+    bool is_audible() const;
+    bool is_sweep_muted() const;
+    uint64_t next_event() const;
+    void advance_to(uint64_t cycle);
     void clock_length_counter();
     void clock_envelope();
     void clock_sweep(bool is_pulse1); 
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+};
+
+class TriangleChannel {
+public:
+    bool control;             // length counter halt and linear counter control
+    uint8_t linear_reload;
+    uint8_t linear_counter;
+    bool linear_reload_flag;
+    uint16_t timer_period;
+    uint64_t next_clock;
+    uint8_t length_counter;
+    bool enabled;
+    uint8_t sequence;
+
+    TriangleChannel();
+    void write_register(uint8_t reg, uint8_t value);
+    uint8_t output() const;
+    bool is_running() const;
+    uint64_t next_event() const;
+    void advance_to(uint64_t cycle);
+    void clock_linear_counter();
+    void clock_length_counter();
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+};
+
+class NoiseChannel {
+public:
+    Envelope envelope;
+    bool mode;
+    uint16_t timer_period;    // in CPU cycles
+    uint64_t next_clock;
+    uint16_t shift_register;
+    uint8_t length_counter;
+    bool enabled;
+
+    NoiseChannel();
+    void write_register(uint8_t reg, uint8_t value);
+    uint8_t output() const;
+    bool is_audible() const;
+    uint64_t next_event() const;
+    void advance_to(uint64_t cycle);
+    void clock_length_counter();
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+};
+
+// Delta modulation channel. Its memory reader fetches sample bytes through
+// the Bus and charges the CPU 4 stall cycles per byte.
+class DmcChannel {
+public:
+    bool irq_enabled;
+    bool loop;
+    uint16_t timer_period;    // in CPU cycles
+    uint64_t next_clock;
+    uint8_t output_level;
+    uint16_t sample_address;
+    uint16_t sample_length;
+    uint16_t current_address;
+    uint16_t bytes_remaining;
+    uint8_t shift_register;
+    uint8_t bits_remaining;
+    bool silence;
+    uint8_t sample_buffer;
+    bool buffer_full;
+    bool irq_flag;
+    uint8_t stall_cycles;
+
+    DmcChannel();
+    void write_register(uint8_t reg, uint8_t value);
+    void set_enabled(bool enabled);
+    uint8_t output() const { return output_level; }
+    bool is_active() const;
+    uint64_t next_event() const;
+    void advance_to(uint64_t cycle, const Mem& memory);
+    void fill_buffer(const Mem& memory);
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+private:
+    void clock_timer(const Mem& memory);
 };
 
+// Output level changes are recorded into a BlipBuffer at the CPU cycle
+// they happen, and resampled to the host rate once per frame.
 class APU {
 public:
+    static constexpr double CPU_CLOCK_RATE = 1789773.0;
     PulseChannel pulse1;
     PulseChannel pulse2;
+    TriangleChannel triangle;
+    NoiseChannel noise;
+    DmcChannel dmc;
     uint64_t cycles;  
+    bool five_step_mode;
+    bool irq_inhibit;
+    bool frame_irq;
+    uint8_t frame_step;
+    uint64_t sequence_start;  // CPU cycle the current frame sequence began
+    uint64_t next_frame_event;
+    uint64_t sync_cycle;      // cached next_sync_cycle(), checked every instruction
     
     APU();
     void write_register(uint16_t addr, uint8_t value);
     uint8_t read_register(uint16_t addr);
-    void clock();  
-    float output();  
+    void run_until(uint64_t cycle, const Mem& memory);
+    // The Bus must run the APU by this cycle so DMC fetches and IRQs land
+    // on time.
+    uint64_t next_sync_cycle() const { return sync_cycle; }
+    uint8_t take_stall_cycles();
+    bool irq_pending() const { return frame_irq || dmc.irq_flag; }
+    float output() const;
+    void end_frame();
+    // Muted, the APU still runs but feeds nothing to the resampler, and
+    // load_state leaves the resampler's clock alone. Run-ahead mutes the
+    // frames it is going to roll back, so their sound never exists.
+    void set_output_muted(bool muted) { output_muted = muted; }
+    void set_sample_rate(double rate);
+    // Retunes the resampler between frames without dropping queued samples.
+    void adjust_sample_rate(double rate) { blip.set_rates(CPU_CLOCK_RATE, rate); }
+    size_t samples_avail() const { return blip.samples_avail(); }
+    size_t read_samples(float* out, size_t count) { return blip.read_samples(out, count); }
+    // Audio already handed to the resampler is not part of the state.
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+private:
+    BlipBuffer blip;
+    uint64_t frame_start;
+    float last_output;
+    bool output_muted;
+    void update_output();
+    uint64_t compute_sync_cycle() const;
+    void clock_frame_sequencer();
+    void clock_quarter_frame();
+    void clock_half_frame();
 };
 
-#endif // APU_H
\ No newline at end of file
+#endif // APU_H
@@ -0,0 +1,44 @@
+#ifndef AUDIO_SYNC_H
+#define AUDIO_SYNC_H
+#include "audio/ring_buffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct AudioMetrics {
+    size_t fill;          // samples queued for the device
+    size_t target;        // fill level the rate control aims for
+    uint64_t underruns;   // callbacks that ran out of samples
+    uint64_t dropped;     // samples discarded because the queue was full
+    double rate_ratio;    // current resampling adjustment
+};
+
+// Makes the audio device the master clock. The emulation thread pushes each
+// frame's samples and waits while the queue is at its target latency; the
+// device callback pulls from the other end. Because the emulated and host
+// clocks never match exactly, the resampling ratio is nudged by up to
+// MAX_RATE_ADJUST to hold the fill level at the target instead of letting it
+// drift into underruns or ever-growing latency.
+class AudioSync {
+public:
+    static constexpr double MAX_RATE_ADJUST = 0.005;
+private:
+    RingBuffer<float> buffer;
+    size_t target_fill;
+    double average_fill;
+    double ratio;
+    float last_sample;
+    std::atomic<uint64_t> underruns;
+    std::atomic<uint64_t> dropped;
+public:
+    AudioSync(double sample_rate, double latency_ms);
+    // Emulation thread.
+    void push(const float* samples, size_t count);
+    bool is_full() const { return buffer.size() >= target_fill; }
+    double update_rate_ratio();
+    AudioMetrics metrics() const;
+    // Audio thread. Pads with the last sample on underrun.
+    void pull(float* out, size_t count);
+};
+
+#endif // AUDIO_SYNC_H
@@ -0,0 +1,39 @@
+#ifndef BLIP_BUFFER_H
+#define BLIP_BUFFER_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Band-limited step synthesis in the style of blargg's blip_buf.
+// Amplitude changes are recorded as deltas at source-clock timestamps and
+// each one is spread over TAPS output samples with a polyphase windowed
+// sinc kernel, so the source never has to be sampled at its own rate.
+// Reading integrates the deltas back into a waveform.
+class BlipBuffer {
+public:
+    static constexpr int PHASE_BITS = 5;
+    static constexpr size_t PHASES = 1 << PHASE_BITS;
+    static constexpr size_t TAPS = 16;
+private:
+    alignas(16) std::array<std::array<float, TAPS>, PHASES> kernel;
+    std::vector<float> buffer;
+    uint64_t factor;    // output samples per clock, 32.32 fixed point
+    uint64_t offset;    // position of the current frame start, 32.32 fixed point
+    double clock_rate;
+    double sample_rate;
+    float integrator;
+    float bass_leak;
+public:
+    BlipBuffer(double clock_rate, double sample_rate, size_t capacity);
+    void set_rates(double clock_rate, double sample_rate);
+    double get_sample_rate() const { return sample_rate; }
+    // clock_time is relative to the start of the current frame.
+    void add_delta(uint64_t clock_time, float delta);
+    void end_frame(uint64_t clock_duration);
+    size_t samples_avail() const { return static_cast<size_t>(offset >> 32); }
+    size_t read_samples(float* out, size_t count);
+    void clear();
+};
+
+#endif // BLIP_BUFFER_H
@@ -0,0 +1,75 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+// Single-producer single-consumer queue. Exactly one thread may write and
+// one other thread may read; neither ever blocks or takes a lock, which is
+// what an audio callback needs. Capacity is rounded up to a power of two so
+// the free-running indices wrap with a mask.
+template <typename T>
+class RingBuffer {
+private:
+    std::unique_ptr<T[]> data;
+    size_t mask;
+    // Keep the two indices on separate cache lines so the threads do not
+    // keep stealing the line from each other.
+    alignas(64) std::atomic<size_t> head;   // written by the producer
+    alignas(64) std::atomic<size_t> tail;   // written by the consumer
+public:
+    explicit RingBuffer(size_t min_capacity)
+        : data(nullptr)
+        , mask(0)
+        , head(0)
+        , tail(0)
+    {
+        if (min_capacity == 0) {
+            throw std::invalid_argument("RingBuffer capacity must be positive");
+        }
+        size_t capacity = 1;
+        while (capacity < min_capacity) {
+            capacity <<= 1;
+        }
+        data = std::make_unique<T[]>(capacity);
+        mask = capacity - 1;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // Approximate from either side; exact from the thread that owns the
+    // index it is about to move.
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Producer side. Returns how many items fit.
+    size_t write(const T* items, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = capacity() - (h - tail.load(std::memory_order_acquire));
+        size_t n = count < free ? count : free;
+        for (size_t i = 0; i < n; i++) {
+            data[(h + i) & mask] = items[i];
+        }
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side. Returns how many items were available.
+    size_t read(T* items, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t avail = head.load(std::memory_order_acquire) - t;
+        size_t n = count < avail ? count : avail;
+        for (size_t i = 0; i < n; i++) {
+            items[i] = data[(t + i) & mask];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+};
+
+#endif // RING_BUFFER_H
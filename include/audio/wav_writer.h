@@ -0,0 +1,39 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class WavFormat {
+    Pcm16,
+    Float32
+};
+
+// Streams mono samples to a RIFF WAVE file. Samples are converted into an
+// in-memory block and written out a block at a time; the header sizes are
+// patched in by close(), which the destructor calls if nobody else did.
+class WavWriter {
+public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+private:
+    std::FILE* file;
+    WavFormat format;
+    uint32_t sample_rate;
+    uint64_t data_bytes;
+    std::vector<uint8_t> buffer;
+    size_t buffer_used;
+    void write_header();
+    void flush();
+public:
+    WavWriter(const std::string& path, uint32_t sample_rate, WavFormat format);
+    ~WavWriter();
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+    void write(const float* samples, size_t count);
+    void close();
+    uint64_t samples_written() const;
+};
+
+#endif // WAV_WRITER_H
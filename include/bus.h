@@ -2,8 +2,12 @@
 #define BUS_H
 #include "mem.h"
 #include "cartridge.h"
+#include "mappers/mapper.h"
 #include "ppu.h"
 #include "joypad.h"
+#include "apu.h"
+#include "save_state.h"
+#include "state_arena.h"
 #include <cstdint>
 #include <vector>
 #include <array>
@@ -15,19 +19,31 @@ const uint16_t RAM_MIRRORS_END = 0x1FFF;
 const uint16_t PPU_REGISTERS = 0x2000;
 const uint16_t PPU_REGISTERS_MIRRORS_END = 0x3FFF;
 
+// Owns the whole machine apart from the CPU registers. All bulk memory
+// (CPU RAM, PPU VRAM, OAM and palette, CHR-RAM) sits in one state arena;
+// PRG-RAM stays with the mapper because it may be backed by a save file.
 class Bus : public Mem {
+private:
+    StateArena arena;
 public:
-    std::array<uint8_t, 2048> cpu_vram;  
-    std::vector<uint8_t> prg_rom;          
-    std::unique_ptr<NesPPU> ppu;            
+    std::span<uint8_t, 2048> cpu_vram;
+    std::unique_ptr<Mapper> mapper;
+    mutable NesPPU ppu;
+    mutable APU apu;
+    uint64_t cycles;
     explicit Bus(Rom rom, std::function<void(const NesPPU&, Joypad&)> gameloop_callback);
     uint8_t mem_read(uint16_t addr) const override;
     void mem_write(uint16_t addr, uint8_t data) override;
     std::function<void(const NesPPU&, Joypad&)> gameloop_callback;
     void tick(uint8_t cpu_cycles);
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+    bool irq_asserted() const { return apu.irq_pending() || mapper->irq; }
     mutable Joypad joypad;
-private:
-    uint8_t read_prg_rom(uint16_t addr) const;
+    mutable Joypad joypad2;
+    bool frame_complete;
+    // Cleared by sound-only players; the PPU then never advances.
+    bool ppu_enabled;
 };
 
 #endif // BUS_H
\ No newline at end of file
@@ -1,18 +1,43 @@
 #ifndef CARTRIDGE_H
 #define CARTRIDGE_H
+#include "rom_image.h"
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <vector>
 #include <string>
 #include <stdexcept>
 
 const uint8_t NES_TAG[4] = {0x4E, 0x45, 0x53, 0x1A};
+const uint8_t NSF_TAG[5] = {0x4E, 0x45, 0x53, 0x4D, 0x1A};
+const size_t NSF_HEADER_SIZE = 0x80;
+// Rom::mapper of the Rom built by Nsf::to_rom(); above NES 2.0's 12-bit
+// mapper numbers, so no cartridge can claim it.
+const uint16_t NSF_MAPPER = 0xFFFF;
 const size_t PRG_ROM_PAGE_SIZE = 16384;
 const size_t CHR_ROM_PAGE_SIZE = 8192;
+const size_t PRG_RAM_PAGE_SIZE = 8192;
 
 enum class Mirroring {
     Vertical,
     Horizontal,
-    FourScreen
+    FourScreen,
+    SingleScreenLower,
+    SingleScreenUpper
+};
+
+enum class Timing {
+    Ntsc,
+    Pal,
+    MultiRegion,
+    Dendy
+};
+
+enum class ConsoleType {
+    Nes,
+    VsSystem,
+    Playchoice10,
+    Extended
 };
 
 class RomParseError: public std::runtime_error {
@@ -21,17 +46,65 @@ public:
         : std::runtime_error(message) {}
 };
 
+class Nsf;
+
 class Rom {
 public:
-    std::vector<uint8_t> prg_rom;
-    std::vector<uint8_t> chr_rom;
-    uint8_t mapper;
+    // Views into image, which owns the bytes. Copying a Rom never copies
+    // PRG or CHR data.
+    std::shared_ptr<const RomImage> image;
+    std::span<const uint8_t> prg_rom;
+    std::span<const uint8_t> chr_rom;
+    uint16_t mapper;
+    uint8_t submapper;
     Mirroring screen_mirroring;
+    // RAM sizes in bytes. iNES 1.0 headers only count PRG-RAM in 8 KB
+    // pages (at least one, and exactly one if the header is dirty) and
+    // get 8 KB of CHR-RAM without CHR ROM.
+    size_t prg_ram_size;
+    size_t prg_nvram_size;
+    size_t chr_ram_size;
+    size_t chr_nvram_size;
+    bool battery;
+    bool nes2;
+    Timing timing;
+    ConsoleType console_type;
+    static Rom create(std::shared_ptr<const RomImage> raw);
+    // Copies raw into a private image.
     static Rom create(const std::vector<uint8_t>& raw);
     
 private:
-    Rom(std::vector<uint8_t> prg, std::vector<uint8_t> chr, 
-        uint8_t map, Mirroring mirror);
+    friend class Nsf;
+    Rom(std::shared_ptr<const RomImage> owner, std::span<const uint8_t> prg,
+        std::span<const uint8_t> chr, uint16_t map, Mirroring mirror);
+};
+
+// NES Sound Format: a music driver plus song data, loaded at load_address
+// and driven by calling init_address once per track and play_address at
+// the header's play rate.
+class Nsf {
+public:
+    uint8_t version;
+    uint8_t total_songs;
+    uint8_t starting_song;       // 1-based, as stored
+    uint16_t load_address;
+    uint16_t init_address;
+    uint16_t play_address;
+    std::string title;
+    std::string artist;
+    std::string copyright;
+    uint16_t play_speed_ntsc;    // microseconds between PLAY calls
+    uint8_t bankswitch_init[8];
+    uint8_t region;
+    uint8_t extra_chips;
+    std::vector<uint8_t> data;
+    static bool is_nsf(std::span<const uint8_t> raw);
+    static Nsf create(std::span<const uint8_t> raw);
+    bool uses_bankswitching() const;
+    // The code and data as 4 KB pages for NsfMapper. Without bankswitching
+    // pages 0-7 are the 32 KB at $8000 with the data at load_address; with
+    // it, the data starts at offset (load_address & 0xFFF) of page 0.
+    Rom to_rom() const;
 };
 
 #endif // CARTRIDGE_H
\ No newline at end of file
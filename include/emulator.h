@@ -0,0 +1,90 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+#include "cpu.h"
+#include "render/renderer.h"
+#include "rom_image.h"
+#include "save_state.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+class RomIndex;
+
+// Frontend-agnostic NES: owns the CPU (and through it the Bus, PPU and
+// joypads) plus the renderer, and runs one video frame at a time.
+// Nothing here depends on SDL.
+class Emulator {
+private:
+    std::unique_ptr<CPU> cpu;
+    std::shared_ptr<const RomImage> image;
+    std::string save_path;
+    Renderer renderer;
+    std::vector<float> audio;
+    double sample_rate;
+    double rate_ratio;
+    uint64_t frames;
+    uint32_t rom_crc32;
+    bool render_enabled;
+    unsigned run_ahead;
+    std::vector<uint8_t> run_ahead_state;
+    std::shared_ptr<const RomIndex> rom_index;
+    void write_state(StateWriter& out) const;
+    void emulate_frame(bool render, bool commit);
+public:
+    Emulator();
+    // For battery-backed carts, a non-empty save_path keeps PRG-RAM in that
+    // file (created if missing).
+    void load_rom(const std::vector<uint8_t>& bytes, const std::string& save_path = "");
+    // Shares the image's PRG/CHR-ROM instead of copying it, so any number
+    // of emulators can run the same mapped file.
+    void load_rom(std::shared_ptr<const RomImage> image, const std::string& save_path = "");
+    // ROMs loaded afterwards get their header corrected from the index's
+    // fix table when their data matches an entry.
+    void set_rom_index(std::shared_ptr<const RomIndex> index) { rom_index = std::move(index); }
+    bool is_loaded() const { return cpu != nullptr; }
+    void set_input(size_t port, uint8_t mask);
+    void run_frame();
+    // Draws the picture from the current PPU state. States are saved at the
+    // end of a frame, so after load_state this shows the frame they ended.
+    void redraw();
+    void reset();
+    // Reloads the cartridge as if the console were switched off and on.
+    // The frame counter keeps running.
+    void power_cycle();
+    // Snapshot of the whole machine, about 7 KB plus cartridge RAM. Saving
+    // and loading copy into and out of the caller's buffer without
+    // allocating. save_state throws StateError if the buffer is smaller
+    // than state_size(); load_state throws it for a damaged state or one
+    // from another ROM, in which case the machine may be partly overwritten
+    // and should be reset.
+    size_t state_size() const;
+    size_t save_state(std::span<uint8_t> buffer) const;
+    void load_state(std::span<const uint8_t> state);
+    void set_sample_rate(double rate);
+    // Scales the output sample rate slightly so a frontend can keep its
+    // audio queue from drifting.
+    void set_rate_ratio(double ratio);
+    // Audio-only and fast-forward callers can skip building the picture;
+    // framebuffer() then keeps the last rendered frame.
+    void set_render_enabled(bool enabled) { render_enabled = enabled; }
+    bool is_render_enabled() const { return render_enabled; }
+    // Run-ahead hides the game's own input lag: after each frame the
+    // machine is saved, run this many frames further with the same input
+    // and without sound, the last one is drawn, and the saved state
+    // is restored. Each frame of run-ahead costs one extra emulated frame.
+    void set_run_ahead(unsigned frames) { run_ahead = frames; }
+    // Frames run while muted produce no samples; for frames that are run
+    // again after being heard once.
+    void set_audio_muted(bool muted);
+    const Frame& framebuffer() const { return renderer.get_frame(); }
+    // Mono samples produced by the last run_frame().
+    const std::vector<float>& audio_samples() const { return audio; }
+    uint64_t frame_count() const { return frames; }
+    // CRC-32 of the PRG and CHR data, identifying the game in save states
+    // and movies.
+    uint32_t rom_crc() const { return rom_crc32; }
+};
+
+#endif // EMULATOR_H
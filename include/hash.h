@@ -0,0 +1,31 @@
+#ifndef HASH_H
+#define HASH_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// CRC-32 as used by zip and the No-Intro/GoodNES databases. Pass the
+// previous result as crc to hash data in pieces.
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+
+using Sha1Digest = std::array<uint8_t, 20>;
+
+class Sha1 {
+public:
+    Sha1();
+    void update(std::span<const uint8_t> data);
+    Sha1Digest finish();
+private:
+    uint32_t state[5];
+    uint8_t block[64];
+    size_t block_used;
+    uint64_t total_bytes;
+    void process(const uint8_t* chunk);
+};
+
+Sha1Digest sha1(std::span<const uint8_t> data);
+std::string to_hex(const Sha1Digest& digest);
+
+#endif // HASH_H
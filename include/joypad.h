@@ -13,16 +13,22 @@ enum JoypadButton : uint8_t {
     BUTTON_A = 0b00000001
 };
 
+// The buttons are latched into the shift register when the strobe is
+// released, so a game reads one consistent snapshot per poll no matter
+// when the frontend updates button_status.
 class Joypad {
 private:
     bool strobe;           
     uint8_t button_index;  
     uint8_t button_status; 
+    uint8_t latched;
 public:
     Joypad();
     void write(uint8_t data); 
     uint8_t read();          
     void set_button_status(JoypadButton button, bool pressed);
+    void set_buttons(uint8_t mask) { button_status = mask; }
+    uint8_t buttons() const { return button_status; }
 };
 
 #endif // JOYPAD_H
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef DISCRETE_H
+#define DISCRETE_H
+#include "mappers/mapper.h"
+
+// Boards built from plain latches rather than a mapper ASIC.
+
+// Mapper 0: fixed 16 or 32 KB PRG and 8 KB CHR.
+class NromMapper : public Mapper {
+public:
+    NromMapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+};
+
+// Mapper 2: switchable 16 KB at $8000, last 16 KB fixed at $C000.
+class UxromMapper : public Mapper {
+public:
+    UxromMapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+};
+
+// Mapper 3: fixed PRG, switchable 8 KB CHR.
+class CnromMapper : public Mapper {
+public:
+    CnromMapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+};
+
+// Mapper 7: switchable 32 KB PRG and single-screen mirroring.
+class AxromMapper : public Mapper {
+public:
+    AxromMapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+};
+
+#endif // DISCRETE_H
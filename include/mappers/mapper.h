@@ -0,0 +1,102 @@
+#ifndef MAPPER_H
+#define MAPPER_H
+#include "cartridge.h"
+#include "prg_ram.h"
+#include "save_state.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Cartridge board logic. The CPU sees PRG through eight 4 KB windows at
+// $8000-$FFFF and the PPU sees CHR through eight 1 KB windows at
+// $0000-$1FFF. Both are plain pointer tables read directly by the Bus and
+// the PPU; a bank switch only repoints a window, nothing is copied.
+// ROM windows point straight into the shared RomImage; CHR-RAM is a block
+// of the owning Bus's state arena.
+class Mapper {
+public:
+    static constexpr size_t PRG_PAGE_SIZE = 0x1000;
+    static constexpr size_t PRG_BANK_SIZE = 0x2000;
+    static constexpr size_t CHR_BANK_SIZE = 0x0400;
+    std::array<const uint8_t*, 8> prg_banks;
+    std::array<const uint8_t*, 8> chr_banks;
+    // Nametable layout the board currently selects; the Bus forwards
+    // changes to the PPU.
+    Mirroring mirroring;
+    // Boards that count scanlines set this; the PPU then reports the PPU
+    // A12 rise of each rendered line through clock_a12().
+    bool uses_a12_clock;
+    // Level of the cartridge's IRQ output, wired to the CPU through the Bus.
+    bool irq;
+    // $6000-$7FFF. Boards with an enable or write-protect bit clear these.
+    PrgRam prg_ram;
+    bool prg_ram_enabled;
+    bool prg_ram_writable;
+    const bool battery;
+
+    // chr_ram must hold chr_ram_size(rom) bytes.
+    Mapper(Rom rom, std::span<uint8_t> chr_ram);
+    static size_t chr_ram_size(const Rom& rom);
+    virtual ~Mapper() = default;
+    Mapper(const Mapper&) = delete;
+    Mapper& operator=(const Mapper&) = delete;
+
+    uint8_t read_prg(uint16_t addr) const {
+        return prg_banks[(addr >> 12) & 7][addr & (PRG_PAGE_SIZE - 1)];
+    }
+    uint8_t read_chr(uint16_t addr) const {
+        return chr_banks[(addr >> 10) & 7][addr & (CHR_BANK_SIZE - 1)];
+    }
+    void write_chr(uint16_t addr, uint8_t data) {
+        if (chr_is_ram) {
+            // With CHR-RAM every window points into chr_ram, which is writable.
+            const_cast<uint8_t*>(chr_banks[(addr >> 10) & 7])[addr & (CHR_BANK_SIZE - 1)] = data;
+        }
+    }
+    // Disabled PRG-RAM reads as open bus, approximated as 0 like the rest
+    // of the Bus.
+    uint8_t read_prg_ram(uint16_t addr) const {
+        return prg_ram_enabled ? prg_ram.read(addr - 0x6000) : 0;
+    }
+    void write_prg_ram(uint16_t addr, uint8_t data) {
+        if (prg_ram_enabled && prg_ram_writable) {
+            prg_ram.write(addr - 0x6000, data);
+        }
+    }
+    // CPU write to $8000-$FFFF.
+    virtual void write_register(uint16_t addr, uint8_t data) = 0;
+    // CPU write to $4020-$5FFF, where only a few boards have registers.
+    virtual void write_expansion(uint16_t, uint8_t) {}
+    virtual void clock_a12() {}
+    // Bank windows are stored as offsets, so a state only loads into a
+    // mapper built from the same cartridge. CHR-RAM is saved with the arena.
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+
+protected:
+    std::shared_ptr<const RomImage> image;
+    std::span<const uint8_t> prg;
+    std::span<const uint8_t> chr;   // CHR ROM, or a view of chr_ram
+    std::span<uint8_t> chr_ram;
+    bool chr_is_ram;
+    // Bank numbers wrap around the available memory, and negative numbers
+    // count back from the last bank.
+    void set_prg_4k(size_t slot, int bank);
+    void set_prg_8k(size_t slot, int bank);
+    void set_prg_16k(size_t slot, int bank);
+    void set_prg_32k(int bank);
+    void set_chr_1k(size_t slot, int bank);
+    void set_chr_4k(size_t slot, int bank);
+    void set_chr_8k(int bank);
+    // Board registers beyond the common bank and RAM state.
+    virtual void save_registers(StateWriter&) const {}
+    virtual void load_registers(StateReader&) {}
+};
+
+// Throws RomParseError for boards that are not implemented.
+std::unique_ptr<Mapper> make_mapper(Rom rom, std::span<uint8_t> chr_ram);
+
+#endif // MAPPER_H
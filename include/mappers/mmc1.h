@@ -0,0 +1,24 @@
+#ifndef MMC1_H
+#define MMC1_H
+#include "mappers/mapper.h"
+
+// Mapper 1 (SxROM). Registers are loaded serially: five writes of bit 0
+// fill a shift register whose address on the last write picks the target.
+class Mmc1Mapper : public Mapper {
+private:
+    uint8_t shift;
+    uint8_t shift_count;
+    uint8_t control;
+    uint8_t chr_bank0;
+    uint8_t chr_bank1;
+    uint8_t prg_bank;
+    void update_banks();
+protected:
+    void save_registers(StateWriter& out) const override;
+    void load_registers(StateReader& in) override;
+public:
+    Mmc1Mapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+};
+
+#endif // MMC1_H
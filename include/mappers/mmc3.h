@@ -0,0 +1,27 @@
+#ifndef MMC3_H
+#define MMC3_H
+#include "mappers/mapper.h"
+
+// Mapper 4 (TxROM). Eight bank registers selected through $8000/$8001,
+// plus a scanline counter clocked by rises of PPU address line A12 that
+// raises an IRQ when it reaches zero.
+class Mmc3Mapper : public Mapper {
+private:
+    uint8_t bank_select;
+    std::array<uint8_t, 8> registers;
+    bool four_screen;
+    uint8_t irq_latch;
+    uint8_t irq_counter;
+    bool irq_reload;
+    bool irq_enabled;
+    void update_banks();
+protected:
+    void save_registers(StateWriter& out) const override;
+    void load_registers(StateReader& in) override;
+public:
+    Mmc3Mapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+    void clock_a12() override;
+};
+
+#endif // MMC3_H
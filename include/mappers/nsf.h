@@ -0,0 +1,15 @@
+#ifndef NSF_H
+#define NSF_H
+#include "mappers/mapper.h"
+
+// The banking of an NSF player: each write to $5FF8-$5FFF selects the
+// 4 KB page of NSF data seen at $8000-$FFFF in that register's slot.
+// Built for the Rom made by Nsf::to_rom(); the player seeds the registers.
+class NsfMapper : public Mapper {
+public:
+    NsfMapper(Rom rom, std::span<uint8_t> chr_ram);
+    void write_register(uint16_t addr, uint8_t data) override;
+    void write_expansion(uint16_t addr, uint8_t data) override;
+};
+
+#endif // NSF_H
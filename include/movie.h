@@ -0,0 +1,45 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Emulator;
+
+enum MovieCommand : uint8_t {
+    MOVIE_RESET = 0x01,     // soft reset before the frame
+    MOVIE_POWER = 0x02      // power cycle before the frame
+};
+
+// Everything the player did during one frame. Pads use the JoypadButton
+// bit layout.
+struct MovieFrame {
+    uint8_t pads[2];
+    uint8_t commands;
+
+    bool operator==(const MovieFrame&) const = default;
+};
+
+// An input movie: the frames played from power-on on one ROM. On disk
+// identical consecutive frames are stored as a single run, so an hour of
+// held buttons takes a few kilobytes.
+class Movie {
+public:
+    uint32_t rom_crc32;     // Emulator::rom_crc(); 0 plays on any ROM
+    std::vector<MovieFrame> frames;
+
+    Movie();
+    // Reads either a movie saved by save() or an FCEUX .fm2 text movie.
+    // FM2 movies carry an MD5 rather than our CRC, so they are not checked
+    // against the ROM. Throws std::runtime_error for damaged files and for
+    // movies of more than 100 hours.
+    static Movie load(const std::string& path);
+    static Movie parse_fm2(const std::string& text);
+    void save(const std::string& path) const;
+};
+
+// Applies the frame's commands and input, then runs it. Recording and
+// playback both go through here so they cannot disagree.
+void play_movie_frame(Emulator& emu, const MovieFrame& frame);
+
+#endif // MOVIE_H
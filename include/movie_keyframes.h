@@ -0,0 +1,47 @@
+#ifndef MOVIE_KEYFRAMES_H
+#define MOVIE_KEYFRAMES_H
+#include "movie.h"
+#include "rom_image.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+class Emulator;
+
+// Seek index for a movie, kept in a sidecar file next to it: a full save
+// state every `interval` frames, starting with the power-on state. Seeking
+// loads the nearest keyframe at or before the target and plays at most
+// interval - 1 frames from there. The states all have the same size, so
+// keyframe i is simply at i * state_size; the file is memory-mapped when
+// loaded.
+class MovieKeyframes {
+private:
+    uint32_t rom_crc32;
+    uint32_t movie_crc32;       // of the frames the index was built from
+    uint32_t movie_frames;
+    uint32_t interval;
+    size_t state_size;
+    size_t count;
+    std::shared_ptr<const RomImage> file;
+    std::span<const uint8_t> states;
+public:
+    MovieKeyframes();
+    // Plays the whole movie on a freshly loaded emulator, which is left at
+    // the movie's end.
+    static MovieKeyframes build(Emulator& emu, const Movie& movie, uint32_t interval);
+    // Throws std::runtime_error if the file is damaged.
+    static MovieKeyframes load(const std::string& path);
+    void save(const std::string& path) const;
+    // False when the index was built from another ROM or other input, in
+    // which case it has to be rebuilt.
+    bool matches(const Emulator& emu, const Movie& movie) const;
+    // Puts the emulator at the state after `frame` frames of the movie.
+    // Throws std::out_of_range past the end of the movie.
+    void seek(Emulator& emu, const Movie& movie, uint64_t frame) const;
+    uint32_t frame_interval() const { return interval; }
+    size_t size() const { return count; }
+    size_t bytes() const { return states.size(); }
+};
+
+#endif // MOVIE_KEYFRAMES_H
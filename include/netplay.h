@@ -0,0 +1,93 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Emulator;
+class UdpLink;
+
+struct NetplayStats {
+    uint64_t rollbacks;
+    uint64_t frames_resimulated;
+    uint32_t max_rollback_frames;
+    double max_rollback_ms;     // longest load_state plus re-simulation
+    uint64_t stalls;            // advance() calls refused at the rollback limit
+    uint64_t hashes_checked;
+};
+
+// Two-player rollback netplay. Every frame runs at once with the remote
+// player's input predicted as their last known one, and local inputs are
+// sent to the peer with each packet until acknowledged, so lost packets
+// only delay them. When the real remote input turns out different, the
+// machine is reloaded from the state saved before that frame and the
+// frames since are run again, silently and without drawing. Only
+// MAX_ROLLBACK frames of states are kept; further ahead of the peer,
+// advance() refuses to run.
+//
+// Both sides hash each state once all inputs before it are known and
+// exchange the hashes; a mismatch means the machines have diverged.
+class RollbackSession {
+public:
+    static constexpr uint32_t MAX_ROLLBACK = 8;
+
+    // local_player is the joypad port (0 or 1) this side controls. With an
+    // input delay, local input is applied that many frames later, which
+    // trades a little lag for fewer rollbacks.
+    RollbackSession(Emulator& emu, UdpLink& link, size_t local_player, unsigned input_delay = 0);
+    // Reads the peer's packets, rolls back if a prediction was wrong and
+    // sends our inputs and latest hash. Call it at least once per frame,
+    // also while waiting.
+    void poll();
+    // Runs the next frame with this input; false (nothing run) if the peer
+    // is MAX_ROLLBACK frames behind.
+    bool advance(uint8_t local_input);
+    // True while this side is running ahead of the peer by two or more
+    // frames; skipping a frame then keeps the two roughly in step.
+    bool should_wait() const;
+    // Frames run so far, and how many of them have both inputs known.
+    uint64_t frame() const { return current_frame; }
+    uint64_t confirmed_frame() const;
+    // Number of our inputs the peer has acknowledged.
+    uint64_t peer_acked() const { return peer_ack; }
+    bool desynced() const { return desync; }
+    uint64_t desync_frame() const { return desync_at; }
+    const NetplayStats& stats() const { return statistics; }
+private:
+    static constexpr size_t HASH_HISTORY = 64;
+    struct HashSlot {
+        uint64_t frame;
+        uint32_t crc;
+        bool valid;
+    };
+    Emulator& emu;
+    UdpLink& link;
+    size_t local_player;
+    uint64_t current_frame;
+    std::vector<uint8_t> local_inputs;
+    std::vector<uint8_t> remote_inputs;     // confirmed, in order
+    std::vector<uint8_t> remote_used;       // what each frame was run with
+    uint64_t rollback_from;
+    std::array<std::vector<uint8_t>, MAX_ROLLBACK + 1> states;  // state before frame f at f % size
+    uint64_t peer_ack;
+    int32_t peer_advantage;
+    uint64_t hashed_frame;
+    uint64_t checked_frame;
+    std::array<HashSlot, HASH_HISTORY> local_hashes;
+    std::array<HashSlot, HASH_HISTORY> remote_hashes;
+    bool desync;
+    uint64_t desync_at;
+    NetplayStats statistics;
+    std::chrono::steady_clock::time_point last_send;
+    uint8_t remote_input(uint64_t frame) const;
+    void run(uint64_t frame);
+    void receive_packet(const uint8_t* data, size_t size);
+    void roll_back();
+    void hash_confirmed();
+    void compare_hashes(uint64_t frame);
+    void send_packet();
+};
+
+#endif // NETPLAY_H
@@ -0,0 +1,39 @@
+#ifndef NSF_PLAYER_H
+#define NSF_PLAYER_H
+#include "cartridge.h"
+#include "cpu.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Plays NSF music on the CPU and APU alone. The PPU is switched off and
+// nothing is rendered. INIT and PLAY run as bounded subroutine calls, and
+// the CPU idles between PLAY calls by jumping the clock ahead.
+class NsfPlayer {
+public:
+    // INIT and PLAY get at most this many cycles before being cut off.
+    static constexpr uint64_t CALL_CYCLE_LIMIT = 1789773;
+private:
+    Nsf nsf;
+    std::unique_ptr<CPU> cpu;
+    std::vector<float> audio;
+    double sample_rate;
+    uint64_t period_cycles;   // CPU cycles between PLAY calls
+    uint64_t next_play;
+    uint8_t track;
+    void call(uint16_t address);
+public:
+    explicit NsfPlayer(Nsf nsf);
+    const Nsf& info() const { return nsf; }
+    void set_sample_rate(double rate);
+    // 0-based track index.
+    void start_track(uint8_t index);
+    uint8_t current_track() const { return track; }
+    // Calls PLAY once, idles until the next call is due, and collects the
+    // audio produced in between.
+    void run_period();
+    const std::vector<float>& audio_samples() const { return audio; }
+    uint64_t cycles() const { return cpu->bus.cycles; }
+};
+
+#endif // NSF_PLAYER_H
@@ -1,6 +1,7 @@
 #ifndef OPCODES_H
 #define OPCODES_H
 #include "addressing_mode.h"
+#include <array>
 #include <cstdint>
 #include <vector>
 #include <unordered_map>
@@ -19,6 +20,8 @@ struct OpCode {
 namespace opcodes {
     const std::vector<OpCode>& get_cpu_opcodes();
     const std::unordered_map<uint8_t, const OpCode*>& get_opcodes_map();
+    // Indexed by opcode byte; nullptr for bytes with no entry.
+    const std::array<const OpCode*, 256>& get_opcode_table();
 }
 
 #endif // OPCODES_H
\ No newline at end of file
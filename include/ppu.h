@@ -1,21 +1,42 @@
 #ifndef PPU_H
 #define PPU_H
 #include "cartridge.h"
+#include "mappers/mapper.h"
 #include "ppu/registers/addr.h"
 #include "ppu/registers/control.h"
 #include "ppu/registers/status.h"
 #include "ppu/registers/mask.h"
 #include "ppu/registers/scroll.h"
+#include "save_state.h"
 #include <cstdint>
 #include <vector>
 #include <array>
+#include <span>
+
+// The picture is drawn once per frame, from what each visible line was
+// fetched with: the PPU captures that as the previous line's sprite
+// fetches start (dot 257), so writes from a scanline IRQ handler, such as
+// CHR bank switches and scroll changes for a status bar, land on the
+// right lines.
+struct ScanlineLatch {
+    std::array<const uint8_t*, 8> chr_banks;
+    std::array<const uint8_t*, 4> nametables;
+    uint8_t ctrl;   // ControlRegister bits
+    uint16_t x;     // 0-511; 256 and up is the right-hand nametable
+    uint16_t y;     // 0-479; 240 and up is the lower nametable
+};
 
 class NesPPU {
 public:
-    std::vector<uint8_t> chr_rom;
-    std::array<uint8_t, 2048> vram;
-    std::array<uint8_t, 256> oam_data;
-    std::array<uint8_t, 32> palette_table;
+    static constexpr size_t VRAM_SIZE = 4096;
+    static constexpr size_t OAM_SIZE = 256;
+    static constexpr size_t PALETTE_SIZE = 32;
+    Mapper* mapper;   // owned by the Bus; supplies the CHR bank windows
+    // Memory lives in the Bus's state arena.
+    std::span<uint8_t, VRAM_SIZE> vram;
+    std::array<uint8_t*, 4> nametables;
+    std::span<uint8_t, OAM_SIZE> oam_data;
+    std::span<uint8_t, PALETTE_SIZE> palette_table;
     Mirroring mirroring;
     AddrRegister addr;
     ControlRegister ctrl;
@@ -27,9 +48,30 @@ public:
     uint16_t cycles;
     uint16_t scanline;
     bool nmi_interrupt;
+    // Not part of save states. lines_valid is false until every visible
+    // line has been latched since power-on or load_state(); until then
+    // current_latch() stands in for them.
+    std::array<ScanlineLatch, 240> lines;
+    bool lines_valid;
 
-    NesPPU(std::vector<uint8_t> chr_rom, Mirroring mirroring);
-    uint16_t mirror_vram_addr(uint16_t addr) const;
+    NesPPU(Mapper* mapper, Mirroring mirroring, std::span<uint8_t, VRAM_SIZE> vram,
+           std::span<uint8_t, OAM_SIZE> oam_data, std::span<uint8_t, PALETTE_SIZE> palette_table);
+    NesPPU(const NesPPU&) = delete;
+    NesPPU& operator=(const NesPPU&) = delete;
+    NesPPU(NesPPU&&) = default;
+    NesPPU& operator=(NesPPU&&) = default;
+    void set_mirroring(Mirroring mirroring);
+    uint8_t& nametable_at(uint16_t addr) {
+        return nametables[(addr >> 10) & 3][addr & 0x3FF];
+    }
+    uint8_t nametable_at(uint16_t addr) const {
+        return nametables[(addr >> 10) & 3][addr & 0x3FF];
+    }
+    uint8_t chr_at(uint16_t addr) const {
+        return mapper->read_chr(addr);
+    }
+    // The latch a line would get from the registers as they are now.
+    ScanlineLatch current_latch(uint16_t line) const;
     void increment_vram_addr();
     uint8_t read_status();
     uint8_t read_oam_data();
@@ -43,6 +85,17 @@ public:
     void write_to_data(uint8_t value);
     bool tick(uint8_t cycles);
     bool poll_nmi_interrupt();
+    // Registers only; the memory is saved with the arena.
+    void save_state(StateWriter& out) const;
+    void load_state(StateReader& in);
+private:
+    // Background row shown on line frame_y_line: the scroll at the start of
+    // the frame, or where a $2006 write during rendering pointed.
+    uint16_t frame_y;
+    uint16_t frame_y_line;
+    uint16_t lines_latched;
+    void clock_mapper_a12(uint16_t from, uint16_t to);
+    void latch_line(uint16_t line);
 };
 
 #endif // PPU_H
\ No newline at end of file
@@ -1,11 +1,11 @@
 #ifndef ADDR_REGISTER_H
 #define ADDR_REGISTER_H
 #include <cstdint>
-#include <utility>
+#include <array>
 
 class AddrRegister {
 private:
-    std::pair<uint8_t, uint8_t> value; // (high_byte, low_byte)
+    std::array<uint8_t, 2> value; // {high_byte, low_byte}
     bool hi_ptr;
     void set(uint16_t data);
 
@@ -15,6 +15,8 @@ public:
     void increment(uint8_t inc);
     void reset_latch();
     uint16_t get() const;
+    // True after the second byte of an address has been written.
+    bool is_complete() const { return hi_ptr; }
 };
 
 #endif // ADDR_REGISTER_H
\ No newline at end of file
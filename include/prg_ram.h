@@ -0,0 +1,62 @@
+#ifndef PRG_RAM_H
+#define PRG_RAM_H
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Cartridge work RAM at $6000-$7FFF. Battery-backed carts can attach a
+// .sav file, which is memory-mapped so the game writes straight into the
+// page cache and a restart sees the saved bytes immediately. Flushing to
+// disk happens on a background thread that frame_end() only signals, so
+// the emulation thread never waits on I/O.
+class PrgRam {
+private:
+    std::vector<uint8_t> memory;
+    uint8_t* bytes;
+    size_t length;
+    bool dirty;
+#if defined(__unix__) || defined(__APPLE__)
+    int fd;
+    void* mapping;
+#else
+    std::string save_path;
+#endif
+    std::thread flusher;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool flush_requested;
+    bool stopping;
+    void flush_loop();
+    void flush_to_disk();
+    void close_file();
+public:
+    explicit PrgRam(size_t size);
+    ~PrgRam();
+    PrgRam(const PrgRam&) = delete;
+    PrgRam& operator=(const PrgRam&) = delete;
+    size_t size() const { return length; }
+    uint8_t* data() { return bytes; }
+    const uint8_t* data() const { return bytes; }
+    // Boards without PRG-RAM get a zero-sized one that reads as 0.
+    uint8_t read(uint16_t offset) const { return length ? bytes[offset % length] : 0; }
+    void write(uint16_t offset, uint8_t value) {
+        if (length) {
+            bytes[offset % length] = value;
+            dirty = true;
+        }
+    }
+    // Creates the file if needed, keeps existing contents, and starts the
+    // flush thread. Throws std::runtime_error on failure.
+    void attach_file(const std::string& path);
+    bool has_file() const { return flusher.joinable(); }
+    // For bulk writes through data(), such as loading a save state.
+    void mark_dirty() { dirty = length > 0; }
+    // Called once per frame by the emulation thread.
+    void frame_end();
+};
+
+#endif // PRG_RAM_H
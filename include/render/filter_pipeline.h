@@ -0,0 +1,29 @@
+#ifndef FILTER_PIPELINE_H
+#define FILTER_PIPELINE_H
+#include "render/frame.h"
+#include "render/filters/filter.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Runs a VideoFilter over each rendered Frame in horizontal bands spread
+// across a thread pool. Output is XRGB8888.
+class FilterPipeline {
+private:
+    std::unique_ptr<VideoFilter> filter;
+    ThreadPool pool;
+    std::vector<uint32_t> source;
+    std::vector<uint32_t> output;
+    size_t width;
+    size_t height;
+    void prepare_source(const Frame& frame);
+public:
+    FilterPipeline(std::unique_ptr<VideoFilter> filter, size_t threads);
+    const uint32_t* process(const Frame& frame);
+    const uint32_t* get_output() const { return output.data(); }
+    size_t output_width() const { return width; }
+    size_t output_height() const { return height; }
+};
+
+#endif // FILTER_PIPELINE_H
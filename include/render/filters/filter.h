@@ -0,0 +1,60 @@
+#ifndef FILTER_H
+#define FILTER_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Source image handed to filters: XRGB8888 pixels with PADDING replicated
+// edge pixels on every side, so kernels can read neighbours unchecked.
+// indices holds the unpadded raw PPU output (see Frame::get_indices).
+struct FilterSource {
+    static constexpr size_t PADDING = 2;
+    const uint32_t* pixels;
+    size_t stride;
+    size_t width;
+    size_t height;
+    const uint16_t* indices;
+    const uint32_t* row(ptrdiff_t y) const {
+        return pixels + (y + static_cast<ptrdiff_t>(PADDING)) * stride + PADDING;
+    }
+};
+
+// A post-Renderer image filter. apply() must only touch the destination
+// rows produced by source rows [row_begin, row_end) so that bands can run
+// on separate threads.
+class VideoFilter {
+public:
+    virtual ~VideoFilter() = default;
+    virtual size_t output_width(size_t width) const = 0;
+    virtual size_t output_height(size_t height) const = 0;
+    virtual void begin_frame() {}
+    virtual void apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+                       size_t row_begin, size_t row_end) const = 0;
+};
+
+// Fills a factor x factor block of an upscaled image with one colour.
+inline void fill_block(uint32_t* out, size_t stride, size_t factor, uint32_t colour) {
+#if defined(__SSE2__)
+    if (factor == 4) {
+        __m128i row = _mm_set1_epi32(static_cast<int>(colour));
+        for (size_t y = 0; y < 4; y++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + y * stride), row);
+        }
+        return;
+    }
+#endif
+    for (size_t y = 0; y < factor; y++) {
+        std::fill_n(out + y * stride, factor, colour);
+    }
+}
+
+// Known names: scale2x, scale3x, scale4x, hq2x, hq3x, hq4x, xbr2x, xbr3x,
+// xbr4x, ntsc.
+std::unique_ptr<VideoFilter> make_filter(const std::string& name);
+
+#endif // FILTER_H
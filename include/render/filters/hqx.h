@@ -0,0 +1,33 @@
+#ifndef HQX_H
+#define HQX_H
+#include "render/filters/filter.h"
+#include <array>
+
+// Maxim Stepin's hq2x/hq3x/hq4x. Each pixel is compared with its eight
+// neighbours using the hqx YUV thresholds, and each corner of the output
+// block is interpolated from the pixel and the neighbours on that side
+// according to which of them differ. The rules are written per corner and
+// mirrored to the others instead of carried as the original 256-case
+// tables, so results are close to, but not bit-identical with, the
+// reference implementation.
+class HqxFilter : public VideoFilter {
+private:
+    struct SubPixel {
+        uint16_t weight;    // 0-256 blend towards the corner colour
+        uint8_t corners;    // corners whose colours are averaged
+        uint8_t corner_count;
+    };
+    size_t factor;
+    std::array<SubPixel, 16> subpixels;
+#if defined(__SSE2__)
+    void blend_block4(uint32_t* out, size_t stride, uint32_t e, const uint32_t* corners) const;
+#endif
+public:
+    explicit HqxFilter(size_t factor);
+    size_t output_width(size_t width) const override { return width * factor; }
+    size_t output_height(size_t height) const override { return height * factor; }
+    void apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+               size_t row_begin, size_t row_end) const override;
+};
+
+#endif // HQX_H
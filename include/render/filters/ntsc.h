@@ -0,0 +1,30 @@
+#ifndef NTSC_H
+#define NTSC_H
+#include "render/filters/filter.h"
+#include <array>
+
+// Composite video emulation. Each PPU pixel is turned back into the eight
+// 21.48 MHz samples of its square-wave signal, then decoded to YIQ with a
+// one-colour-cycle window, which reproduces artifact colours and dot crawl.
+// Works from FilterSource::indices, so emphasis bits are honoured.
+class NtscFilter : public VideoFilter {
+public:
+    static constexpr size_t SAMPLES_PER_PIXEL = 8;
+    static constexpr size_t PHASES = 12;
+private:
+    // Signal level for every 9-bit pixel at each subcarrier phase, stored
+    // twice over so any 8 consecutive phases can be loaded in one go.
+    std::array<std::array<float, PHASES * 2>, 512> levels;
+    std::array<float, PHASES * 2> cos_table;
+    std::array<float, PHASES * 2> sin_table;
+    unsigned frame_phase;
+public:
+    NtscFilter();
+    size_t output_width(size_t width) const override { return (width * 602 + 255) / 256; }
+    size_t output_height(size_t height) const override { return height; }
+    void begin_frame() override;
+    void apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+               size_t row_begin, size_t row_end) const override;
+};
+
+#endif // NTSC_H
@@ -0,0 +1,17 @@
+#ifndef SCALEX_H
+#define SCALEX_H
+#include "render/filters/filter.h"
+
+// AdvMAME Scale2x/Scale3x. Scale4x is Scale2x applied twice.
+class ScaleXFilter : public VideoFilter {
+private:
+    size_t factor;
+public:
+    explicit ScaleXFilter(size_t factor);
+    size_t output_width(size_t width) const override { return width * factor; }
+    size_t output_height(size_t height) const override { return height * factor; }
+    void apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+               size_t row_begin, size_t row_end) const override;
+};
+
+#endif // SCALEX_H
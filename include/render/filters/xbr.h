@@ -0,0 +1,21 @@
+#ifndef XBR_H
+#define XBR_H
+#include "render/filters/filter.h"
+#include <array>
+
+// Hyllian's xBR (level 1 edge rules) at 2x, 3x or 4x.
+class XbrFilter : public VideoFilter {
+private:
+    size_t factor;
+    // Blend weight (0-256) of the edge colour for each output sub-pixel of
+    // the bottom-right corner; the other corners are rotations of it.
+    std::array<uint16_t, 16> corner_weights;
+public:
+    explicit XbrFilter(size_t factor);
+    size_t output_width(size_t width) const override { return width * factor; }
+    size_t output_height(size_t height) const override { return height * factor; }
+    void apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+               size_t row_begin, size_t row_end) const override;
+};
+
+#endif // XBR_H
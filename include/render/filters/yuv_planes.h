@@ -0,0 +1,72 @@
+#ifndef YUV_PLANES_H
+#define YUV_PLANES_H
+#include "render/filters/filter.h"
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// One band of a FilterSource converted to planar YUV for the edge-detecting
+// filters (xBR, hqx). Planes keep PADDING border pixels on every side and
+// use 32-bit lanes so four neighbouring pixels load into one SSE2 register.
+class YuvPlanes {
+public:
+    static constexpr ptrdiff_t PAD = FilterSource::PADDING;
+private:
+    std::vector<int32_t> y_plane;
+    std::vector<int32_t> u_plane;
+    std::vector<int32_t> v_plane;
+    ptrdiff_t plane_stride;
+    size_t first_row;
+public:
+    YuvPlanes();
+    // Converts source rows [row_begin - PAD, row_end + PAD).
+    void convert(const FilterSource& src, size_t row_begin, size_t row_end);
+    ptrdiff_t stride() const { return plane_stride; }
+    // Index of source pixel (x, y); y must lie inside the converted rows.
+    ptrdiff_t index(size_t x, size_t y) const {
+        return (static_cast<ptrdiff_t>(y - first_row) + PAD) * plane_stride + PAD + static_cast<ptrdiff_t>(x);
+    }
+
+    // Weighted YUV distance used by xBR.
+    int distance(ptrdiff_t a, ptrdiff_t b) const {
+        return 48 * std::abs(y_plane[a] - y_plane[b]) + 7 * std::abs(u_plane[a] - u_plane[b])
+             + 6 * std::abs(v_plane[a] - v_plane[b]);
+    }
+    // hqx's threshold test: true if the two pixels are visibly different.
+    bool differs(ptrdiff_t a, ptrdiff_t b) const {
+        return std::abs(y_plane[a] - y_plane[b]) > 48 || std::abs(u_plane[a] - u_plane[b]) > 7
+            || std::abs(v_plane[a] - v_plane[b]) > 6;
+    }
+
+#if defined(__SSE2__)
+    // The same for pixels a..a+3 against b..b+3; differs4 gives all-ones
+    // lanes where they differ.
+    __m128i distance4(ptrdiff_t a, ptrdiff_t b) const {
+        __m128i dy = abs_difference(y_plane.data(), a, b);
+        __m128i du = abs_difference(u_plane.data(), a, b);
+        __m128i dv = abs_difference(v_plane.data(), a, b);
+        __m128i y48 = _mm_add_epi32(_mm_slli_epi32(dy, 5), _mm_slli_epi32(dy, 4));
+        __m128i u7 = _mm_sub_epi32(_mm_slli_epi32(du, 3), du);
+        __m128i v6 = _mm_add_epi32(_mm_slli_epi32(dv, 2), _mm_slli_epi32(dv, 1));
+        return _mm_add_epi32(y48, _mm_add_epi32(u7, v6));
+    }
+    __m128i differs4(ptrdiff_t a, ptrdiff_t b) const {
+        __m128i dy = _mm_cmpgt_epi32(abs_difference(y_plane.data(), a, b), _mm_set1_epi32(48));
+        __m128i du = _mm_cmpgt_epi32(abs_difference(u_plane.data(), a, b), _mm_set1_epi32(7));
+        __m128i dv = _mm_cmpgt_epi32(abs_difference(v_plane.data(), a, b), _mm_set1_epi32(6));
+        return _mm_or_si128(dy, _mm_or_si128(du, dv));
+    }
+private:
+    static __m128i abs_difference(const int32_t* plane, ptrdiff_t a, ptrdiff_t b) {
+        __m128i d = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + a)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + b)));
+        __m128i sign = _mm_srai_epi32(d, 31);
+        return _mm_sub_epi32(_mm_xor_si128(d, sign), sign);
+    }
+#endif
+};
+
+#endif // YUV_PLANES_H
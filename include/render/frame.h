@@ -1,6 +1,7 @@
 #ifndef FRAME_H
 #define FRAME_H
 #include <cstdint>
+#include <cstddef>
 #include <array>
 
 class Frame {
@@ -9,11 +10,15 @@ public:
     static constexpr size_t HEIGHT = 240;
 private:
     std::array<uint8_t, WIDTH * HEIGHT * 3> data;
+    // Raw PPU output per pixel: palette index | emphasis bits << 6.
+    std::array<uint16_t, WIDTH * HEIGHT> indices;
 public:
     Frame();
     void set_pixel(size_t x, size_t y, uint8_t r, uint8_t g, uint8_t b);
     void set_pixel(size_t x, size_t y, const std::array<uint8_t, 3>& rgb);
+    void set_palette_pixel(size_t x, size_t y, uint16_t nes_pixel);
     const uint8_t* get_data() const { return data.data(); }
+    const uint16_t* get_indices() const { return indices.data(); }
 };
 
 #endif // FRAME_H
@@ -6,15 +6,20 @@
 #include <cstdint>
 #include <array>
 
+// Draws a whole frame at once, line by line from the PPU's scanline
+// latches.
 class Renderer {
 private:
     Frame frame;
+    uint16_t emphasis;
+    const ScanlineLatch* lines;
+    std::array<ScanlineLatch, Frame::HEIGHT> fallback_lines;
 public:
     Renderer();
     void render(const NesPPU& ppu);
     const Frame& get_frame() const;
 private:
-    std::array<uint8_t, 4> bg_palette(const NesPPU& ppu, size_t tile_column, size_t tile_row, uint16_t nametable_base) const;
+    std::array<uint8_t, 4> bg_palette(const NesPPU& ppu, size_t tile_column, size_t tile_row, const uint8_t* nametable) const;
     std::array<uint8_t, 4> sprite_palette(const NesPPU& ppu, uint8_t palette_idx) const;
     void render_background(const NesPPU& ppu);
     void render_sprites(const NesPPU& ppu);
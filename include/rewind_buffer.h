@@ -0,0 +1,48 @@
+#ifndef REWIND_BUFFER_H
+#define REWIND_BUFFER_H
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// History of save states for stepping backwards frame by frame. Only the
+// newest state is kept whole; every older one is stored as the XOR of it
+// and its successor, run-length encoded, since a frame usually changes a
+// few hundred bytes of a ~15 KB state. Deltas live in a fixed-size byte
+// ring and the oldest are dropped when it fills, so memory never grows
+// after construction.
+class RewindBuffer {
+public:
+    // Holds up to max_states states of exactly state_size bytes in about
+    // capacity_bytes of delta storage.
+    RewindBuffer(size_t state_size, size_t max_states, size_t capacity_bytes);
+    void push(std::span<const uint8_t> state);
+    // Copies the newest state into state and forgets it. Returns false
+    // when the history is empty.
+    bool pop(std::span<uint8_t> state);
+    void clear();
+    size_t size() const { return count; }
+    size_t state_size() const { return current.size(); }
+    // Delta bytes in use, excluding the newest whole state.
+    size_t bytes_used() const { return used; }
+
+private:
+    struct Record {
+        size_t offset;
+        size_t length;
+    };
+    std::vector<uint8_t> current;   // the newest state
+    std::vector<uint8_t> ring;      // encoded deltas
+    std::vector<uint8_t> scratch;   // one worst-case encoded delta
+    std::vector<Record> records;    // circular, oldest at first_record
+    size_t first_record;
+    size_t record_count;
+    size_t ring_head;               // where the next delta starts
+    size_t used;
+    size_t count;
+    size_t encode_delta(std::span<const uint8_t> state);
+    void apply_delta(const uint8_t* delta, size_t length);
+    void drop_oldest();
+};
+
+#endif // REWIND_BUFFER_H
@@ -0,0 +1,34 @@
+#ifndef ROM_IMAGE_H
+#define ROM_IMAGE_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Immutable bytes of a ROM file. Files are memory-mapped read-only, so
+// every emulator instance holding the same RomImage (and every process
+// mapping the same file) reads one shared physical copy from the page
+// cache. Rom and the mappers keep spans into it plus a shared_ptr that
+// keeps the mapping alive.
+class RomImage {
+private:
+    const uint8_t* bytes;
+    size_t length;
+    std::vector<uint8_t> owned;   // used when the bytes did not come from a file
+    void* mapping;
+    RomImage();
+public:
+    ~RomImage();
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+    // Throws std::runtime_error if the file cannot be opened or mapped.
+    static std::shared_ptr<const RomImage> map_file(const std::string& path);
+    static std::shared_ptr<const RomImage> from_bytes(std::vector<uint8_t> bytes);
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::span<const uint8_t> span() const { return {bytes, length}; }
+};
+
+#endif // ROM_IMAGE_H
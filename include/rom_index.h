@@ -0,0 +1,71 @@
+#ifndef ROM_INDEX_H
+#define ROM_INDEX_H
+#include "cartridge.h"
+#include "hash.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One scanned file. Hashes cover the ROM data after the header and
+// trainer, which is how cart databases identify a game regardless of
+// what its header claims.
+struct RomIndexEntry {
+    std::string path;
+    int64_t mtime;
+    uint64_t file_size;
+    uint32_t prg_size;
+    uint32_t chr_size;
+    uint32_t prg_crc32;
+    uint32_t chr_crc32;
+    uint32_t rom_crc32;      // PRG followed by CHR
+    Sha1Digest rom_sha1;
+    uint16_t mapper;
+    uint8_t submapper;
+    Mirroring mirroring;
+    bool battery;
+    bool nes2;
+    bool valid;              // false if Rom::create rejected the file
+};
+
+// Corrected header values for a cart, matched by its rom_crc32.
+struct HeaderFix {
+    uint32_t rom_crc32;
+    uint16_t mapper;
+    uint8_t submapper;
+    Mirroring mirroring;
+    bool battery;
+};
+
+struct ScanStats {
+    size_t files;
+    size_t hashed;
+    size_t unchanged;
+    size_t invalid;
+};
+
+// Library of ROM files plus a header-fix table, stored as a compact
+// little-endian binary file: fixed-size records followed by one string
+// table for the paths.
+class RomIndex {
+public:
+    std::vector<RomIndexEntry> entries;   // sorted by path
+    std::vector<HeaderFix> fixes;         // sorted by rom_crc32
+
+    // Throws std::runtime_error if the file is unreadable or malformed.
+    static RomIndex load(const std::string& path);
+    // Writes to a temporary file and renames it over path.
+    void save(const std::string& path) const;
+    // Walks the roots (directories or single files) for .nes files. Files
+    // whose size and mtime match their previous entry keep it; the rest
+    // are mapped and hashed on the pool. Files that disappeared are dropped.
+    ScanStats scan(const std::vector<std::string>& roots, ThreadPool& pool);
+    const HeaderFix* find_fix(uint32_t rom_crc32) const;
+    // Replaces any existing fix for the same cart.
+    void set_fix(const HeaderFix& fix);
+    // Overrides rom's header fields if the index has a fix for its data.
+    bool apply_fix(Rom& rom) const;
+};
+
+#endif // ROM_INDEX_H
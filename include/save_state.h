@@ -0,0 +1,86 @@
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Save states are a short header followed by chunks. Each chunk carries a
+// four-character tag, its own version and its length, so a reader can find
+// chunks by tag and a component can change its layout without breaking the
+// others. Values are copied in native byte order: a state is meant for the
+// build that wrote it, not as an interchange format. Only types without
+// padding are accepted, so equal machines always produce equal bytes and
+// states can be hashed.
+//
+// Writers and readers work on caller-owned buffers and never allocate.
+
+const uint8_t STATE_MAGIC[4] = {'N', 'E', 'S', 'S'};
+const uint32_t STATE_FORMAT_VERSION = 1;
+
+class StateError: public std::runtime_error {
+public:
+    explicit StateError(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
+class StateWriter {
+public:
+    // A writer without a buffer only counts bytes, for sizing one.
+    StateWriter();
+    explicit StateWriter(std::span<uint8_t> buffer);
+    void begin_chunk(const char (&tag)[5], uint16_t version);
+    void end_chunk();
+    template<typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "state values are copied bytewise");
+        static_assert(std::has_unique_object_representations_v<T>, "state values must not contain padding");
+        write_bytes(&value, sizeof(T));
+    }
+    // Throws StateError when the buffer is full.
+    void write_bytes(const void* data, size_t size);
+    size_t size() const { return pos; }
+private:
+    std::span<uint8_t> buffer;
+    bool counting;
+    size_t pos;
+    size_t chunk_start;
+};
+
+class StateReader {
+public:
+    // Checks the header and that every chunk fits in the buffer; throws
+    // StateError otherwise.
+    explicit StateReader(std::span<const uint8_t> buffer);
+    // Moves to the chunk with this tag and returns its version. Throws
+    // StateError if the state has no such chunk.
+    uint16_t open_chunk(const char (&tag)[5]);
+    template<typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "state values are copied bytewise");
+        static_assert(std::has_unique_object_representations_v<T>, "state values must not contain padding");
+        read_bytes(&value, sizeof(T));
+    }
+    template<typename T>
+    T read() {
+        T value;
+        read(value);
+        return value;
+    }
+    // Throws StateError when reading past the end of the open chunk.
+    void read_bytes(void* data, size_t size);
+    // Like read_bytes, but returns the bytes in place instead of copying.
+    std::span<const uint8_t> read_view(size_t size);
+    // Throws StateError unless the open chunk was read exactly to its end.
+    void close_chunk();
+private:
+    std::span<const uint8_t> buffer;
+    size_t pos;
+    size_t chunk_end;
+    const char* chunk_tag;
+};
+
+#endif // SAVE_STATE_H
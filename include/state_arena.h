@@ -0,0 +1,47 @@
+#ifndef STATE_ARENA_H
+#define STATE_ARENA_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+
+// One zeroed, cache-line aligned allocation holding an instance's bulk
+// mutable memory. Blocks are laid out back to back, each starting on its
+// own cache line, and components keep spans into them. The memory is
+// contiguous, so a snapshot copies it in one go, and moving the arena (or
+// the object that owns it) leaves those spans valid.
+class StateArena {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t MAX_BLOCKS = 8;
+
+    explicit StateArena(std::initializer_list<size_t> block_sizes);
+    std::span<uint8_t> block(size_t index) const {
+        return {memory.get() + offsets[index], sizes[index]};
+    }
+    template<size_t N>
+    std::span<uint8_t, N> block(size_t index) const {
+        if (sizes[index] != N) {
+            throw std::logic_error("State arena block has the wrong size");
+        }
+        return std::span<uint8_t, N>(memory.get() + offsets[index], N);
+    }
+    std::span<uint8_t> bytes() const { return {memory.get(), length}; }
+    const uint8_t* data() const { return memory.get(); }
+    size_t size() const { return length; }
+
+private:
+    struct AlignedDelete {
+        void operator()(uint8_t* p) const { ::operator delete[](p, std::align_val_t(ALIGNMENT)); }
+    };
+    std::unique_ptr<uint8_t[], AlignedDelete> memory;
+    size_t length;
+    std::array<size_t, MAX_BLOCKS> offsets;
+    std::array<size_t, MAX_BLOCKS> sizes;
+};
+
+#endif // STATE_ARENA_H
@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size pool for splitting one job into independent pieces.
+// parallel_for must only be called from one thread at a time.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    size_t size() const { return workers.size() + 1; }
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* job;
+    size_t job_count;
+    std::atomic<size_t> next_index;
+    size_t busy_workers;
+    uint64_t generation;
+    bool stopping;
+    void worker_loop();
+    void run_jobs();
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,55 @@
+#ifndef UDP_LINK_H
+#define UDP_LINK_H
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// Non-blocking IPv4 UDP socket talking to a single peer. For testing on
+// one machine it can hold back outgoing packets by a fixed latency plus
+// jitter and drop a fraction of them; delayed packets go out from
+// receive() and flush().
+class UdpLink {
+public:
+    // Port 0 picks a free port. Throws std::runtime_error on socket errors
+    // and on platforms without POSIX sockets.
+    explicit UdpLink(uint16_t local_port);
+    ~UdpLink();
+    UdpLink(const UdpLink&) = delete;
+    UdpLink& operator=(const UdpLink&) = delete;
+    uint16_t local_port() const { return port; }
+    // Accepts "host:port"; packets from anyone else are ignored.
+    void connect(const std::string& address);
+    void connect(const std::string& host, uint16_t port);
+    void simulate(double latency_ms, double jitter_ms, double loss, uint32_t seed);
+    void send(std::span<const uint8_t> packet);
+    // Returns the size of the next packet from the peer, or 0 if none is
+    // waiting. Longer packets are truncated to the buffer.
+    size_t receive(std::span<uint8_t> buffer);
+    void flush();
+    uint64_t packets_sent() const { return sent; }
+    uint64_t packets_dropped() const { return dropped; }
+private:
+    struct Delayed {
+        std::chrono::steady_clock::time_point due;
+        std::vector<uint8_t> bytes;
+    };
+    int fd;
+    uint16_t port;
+    uint32_t peer_ip;       // host byte order
+    uint16_t peer_port;
+    double latency_ms;
+    double jitter_ms;
+    double loss;
+    std::mt19937 random;
+    std::deque<Delayed> delayed;
+    uint64_t sent;
+    uint64_t dropped;
+    void transmit(std::span<const uint8_t> packet);
+};
+
+#endif // UDP_LINK_H
@@ -1,59 +1,170 @@
 #include "apu.h"
+#include <algorithm>
+
+namespace {
+
+const uint8_t length_table[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+const uint16_t noise_period_table[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+// Frame sequencer steps in CPU cycles from the start of a sequence, with the
+// frame units each step clocks. The last entry marks the sequence length.
+const uint8_t QUARTER_FRAME = 0x01;
+const uint8_t HALF_FRAME = 0x02;
+const uint8_t FRAME_IRQ = 0x04;
+
+struct FrameStep {
+    uint32_t cycle;
+    uint8_t clocks;
+};
+
+const FrameStep four_step_sequence[5] = {
+    {7457, QUARTER_FRAME},
+    {14913, QUARTER_FRAME | HALF_FRAME},
+    {22371, QUARTER_FRAME},
+    {29829, QUARTER_FRAME | HALF_FRAME | FRAME_IRQ},
+    {29830, 0}
+};
+
+const FrameStep five_step_sequence[6] = {
+    {7457, QUARTER_FRAME},
+    {14913, QUARTER_FRAME | HALF_FRAME},
+    {22371, QUARTER_FRAME},
+    {29829, 0},
+    {37281, QUARTER_FRAME | HALF_FRAME},
+    {37282, 0}
+};
+
+const uint16_t dmc_rate_table[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+// The 2A03 mixes its channels through two non-linear resistor networks.
+// Both curves depend only on the summed channel levels, so they are
+// precomputed once instead of evaluated per output change.
+struct MixerTables {
+    float pulse[31];
+    float tnd[203];
+
+    MixerTables() {
+        pulse[0] = 0.0f;
+        for (int n = 1; n < 31; n++) {
+            pulse[n] = 95.52f / (8128.0f / n + 100.0f);
+        }
+        tnd[0] = 0.0f;
+        for (int n = 1; n < 203; n++) {
+            tnd[n] = 163.67f / (24329.0f / n + 100.0f);
+        }
+    }
+};
+
+const MixerTables mixer;
+
+}
+
+Envelope::Envelope()
+    : start(false), loop(false), constant_volume(false), volume(0),
+      divider(0), decay(0) {
+}
+
+void Envelope::write(uint8_t value) {
+    loop = (value & 0x20) != 0;
+    constant_volume = (value & 0x10) != 0;
+    volume = value & 0x0F;
+}
+
+void Envelope::clock() {
+    if (start) {
+        start = false;
+        decay = 15;
+        divider = volume;
+    } else if (divider > 0) {
+        divider--;
+    } else {
+        divider = volume;
+        if (decay > 0) {
+            decay--;
+        } else if (loop) {
+            decay = 15; 
+        }
+    }
+}
 
 PulseChannel::PulseChannel() 
-    : duty_cycle(0), length_counter_halt(false), constant_volume(false),
-      volume(0), sweep_enabled(false), sweep_period(0), sweep_negate(false),
-      sweep_shift(0), timer_period(0), timer_value(0), length_counter(0),
-      enabled(false), duty_sequence(0), envelope_divider(0), 
-      envelope_counter(0), envelope_start(false) {
+    : duty_cycle(0), sweep_enabled(false), sweep_period(0), sweep_negate(false),
+      sweep_shift(0), sweep_divider(0), sweep_reload(false), timer_period(0), next_clock(0), length_counter(0),
+      enabled(false), duty_sequence(0) {
 }
 
 void PulseChannel::write_register(uint8_t reg, uint8_t value) {
     switch(reg) {
         case 0: 
             duty_cycle = (value >> 6) & 0x03;
-            length_counter_halt = (value & 0x20) != 0;
-            constant_volume = (value & 0x10) != 0;
-            volume = value & 0x0F;
-            envelope_start = true;
+            envelope.write(value);
+            envelope.start = true;
             break;
         case 1: 
             sweep_enabled = (value & 0x80) != 0;
             sweep_period = (value >> 4) & 0x07;
             sweep_negate = (value & 0x08) != 0;
             sweep_shift = value & 0x07;
+            sweep_reload = true;
             break;
         case 2:
             timer_period = (timer_period & 0x0700) | value;
             break;
         case 3: 
             timer_period = (timer_period & 0x00FF) | ((value & 0x07) << 8);
-            static const uint8_t length_table[32] = {
-                10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
-                12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
-            };
-            length_counter = length_table[value >> 3];
+            if (enabled) {
+                length_counter = length_table[value >> 3];
+            }
             duty_sequence = 0;  
-            envelope_start = true;
+            envelope.start = true;
             break;
     }
 }
 
-void PulseChannel::clock_timer() {
-    if (timer_value == 0) {
-        timer_value = timer_period;
-        duty_sequence = (duty_sequence + 1) % 8;
-    } else {
-        timer_value--;
+bool PulseChannel::is_audible() const {
+    return enabled && length_counter > 0 && !is_sweep_muted();
+}
+
+// The sweep unit silences the channel whenever the current period is too
+// short or its target would overflow, even while sweeping is disabled.
+// Negated targets never overflow, so the channel-specific ones' complement
+// adjustment does not matter here.
+bool PulseChannel::is_sweep_muted() const {
+    if (timer_period < 8) {
+        return true;
     }
+    return !sweep_negate && timer_period + (timer_period >> sweep_shift) > 0x7FF;
 }
 
-float PulseChannel::output() {
-    if (!enabled || length_counter == 0) {
-        return 0.0f;
+// A silent channel only needs its duty position to be right once it
+// becomes audible, so it is caught up arithmetically instead of scheduled.
+uint64_t PulseChannel::next_event() const {
+    return is_audible() ? next_clock : APU_NO_EVENT;
+}
+
+// The timer counts APU cycles (two CPU cycles) and steps the duty sequencer
+// on every reload.
+void PulseChannel::advance_to(uint64_t cycle) {
+    if (cycle < next_clock) {
+        return;
     }
-    if (timer_period < 8) {
-        return 0.0f;
+    uint64_t period = 2 * (static_cast<uint64_t>(timer_period) + 1);
+    uint64_t reloads = (cycle - next_clock) / period + 1;
+    duty_sequence = (duty_sequence + reloads) % 8;
+    next_clock += reloads * period;
+}
+
+uint8_t PulseChannel::output() const {
+    if (!is_audible()) {
+        return 0;
     }
     static const uint8_t duty_table[4] = {
         0b01000000, 
@@ -64,69 +175,612 @@ float PulseChannel::output() {
     uint8_t pattern = duty_table[duty_cycle];
     bool waveform_high = (pattern >> (7 - duty_sequence)) & 1;
     if (!waveform_high) {
-        return 0.0f;
+        return 0;
     }
-    uint8_t vol = constant_volume ? volume : envelope_counter;
-    return vol / 15.0f; 
+    return envelope.output();
 }
 
 void PulseChannel::clock_envelope() {
-    if (envelope_start) {
-        envelope_start = false;
-        envelope_counter = 15;
-        envelope_divider = volume;
-    } else if (envelope_divider > 0) {
-        envelope_divider--;
-    } else {
-        envelope_divider = volume;
-        if (envelope_counter > 0) {
-            envelope_counter--;
-        } else if (length_counter_halt) {
-            envelope_counter = 15; 
+    envelope.clock();
+}
+
+// Pulse 1 negates with ones' complement, pulse 2 with two's complement.
+void PulseChannel::clock_sweep(bool is_pulse1) {
+    if (sweep_divider == 0 && sweep_enabled && sweep_shift > 0 && !is_sweep_muted()) {
+        uint16_t change = timer_period >> sweep_shift;
+        if (sweep_negate) {
+            uint16_t adjust = is_pulse1 ? change + 1 : change;
+            timer_period = adjust > timer_period ? 0 : timer_period - adjust;
+        } else {
+            timer_period += change;
         }
     }
+    if (sweep_divider == 0 || sweep_reload) {
+        sweep_divider = sweep_period;
+        sweep_reload = false;
+    } else {
+        sweep_divider--;
+    }
 }
 
 void PulseChannel::clock_length_counter() {
-    if (length_counter > 0 && !length_counter_halt) {
+    if (length_counter > 0 && !envelope.loop) {
+        length_counter--;
+    }
+}
+
+TriangleChannel::TriangleChannel()
+    : control(false), linear_reload(0), linear_counter(0),
+      linear_reload_flag(false), timer_period(0), next_clock(0),
+      length_counter(0), enabled(false), sequence(0) {
+}
+
+void TriangleChannel::write_register(uint8_t reg, uint8_t value) {
+    switch(reg) {
+        case 0:
+            control = (value & 0x80) != 0;
+            linear_reload = value & 0x7F;
+            break;
+        case 2:
+            timer_period = (timer_period & 0x0700) | value;
+            break;
+        case 3:
+            timer_period = (timer_period & 0x00FF) | ((value & 0x07) << 8);
+            if (enabled) {
+                length_counter = length_table[value >> 3];
+            }
+            linear_reload_flag = true;
+            break;
+    }
+}
+
+// Periods below 2 are ultrasonic; the sequencer is held there instead of
+// aliasing into audible noise.
+bool TriangleChannel::is_running() const {
+    return length_counter > 0 && linear_counter > 0 && timer_period >= 2;
+}
+
+uint64_t TriangleChannel::next_event() const {
+    return is_running() ? next_clock : APU_NO_EVENT;
+}
+
+// The triangle timer runs at the CPU clock. A halted sequencer keeps its
+// position, so the output holds its last level.
+void TriangleChannel::advance_to(uint64_t cycle) {
+    if (cycle < next_clock) {
+        return;
+    }
+    uint64_t period = static_cast<uint64_t>(timer_period) + 1;
+    uint64_t reloads = (cycle - next_clock) / period + 1;
+    if (is_running()) {
+        sequence = (sequence + reloads) % 32;
+    }
+    next_clock += reloads * period;
+}
+
+uint8_t TriangleChannel::output() const {
+    return sequence < 16 ? 15 - sequence : sequence - 16;
+}
+
+void TriangleChannel::clock_linear_counter() {
+    if (linear_reload_flag) {
+        linear_counter = linear_reload;
+    } else if (linear_counter > 0) {
+        linear_counter--;
+    }
+    if (!control) {
+        linear_reload_flag = false;
+    }
+}
+
+void TriangleChannel::clock_length_counter() {
+    if (length_counter > 0 && !control) {
+        length_counter--;
+    }
+}
+
+NoiseChannel::NoiseChannel()
+    : mode(false), timer_period(noise_period_table[0]), next_clock(0),
+      shift_register(1), length_counter(0), enabled(false) {
+}
+
+void NoiseChannel::write_register(uint8_t reg, uint8_t value) {
+    switch(reg) {
+        case 0:
+            envelope.write(value);
+            break;
+        case 2:
+            mode = (value & 0x80) != 0;
+            timer_period = noise_period_table[value & 0x0F];
+            break;
+        case 3:
+            if (enabled) {
+                length_counter = length_table[value >> 3];
+            }
+            envelope.start = true;
+            break;
+    }
+}
+
+bool NoiseChannel::is_audible() const {
+    return enabled && length_counter > 0;
+}
+
+// While silent the LFSR sequence is unobservable, so only the timer phase
+// is kept up to date.
+uint64_t NoiseChannel::next_event() const {
+    return is_audible() ? next_clock : APU_NO_EVENT;
+}
+
+void NoiseChannel::advance_to(uint64_t cycle) {
+    if (cycle < next_clock) {
+        return;
+    }
+    uint64_t reloads = (cycle - next_clock) / timer_period + 1;
+    if (is_audible()) {
+        int tap = mode ? 6 : 1;
+        for (uint64_t i = 0; i < reloads; i++) {
+            uint16_t feedback = (shift_register ^ (shift_register >> tap)) & 1;
+            shift_register = (shift_register >> 1) | (feedback << 14);
+        }
+    }
+    next_clock += reloads * timer_period;
+}
+
+uint8_t NoiseChannel::output() const {
+    if (!is_audible() || (shift_register & 1)) {
+        return 0;
+    }
+    return envelope.output();
+}
+
+void NoiseChannel::clock_length_counter() {
+    if (length_counter > 0 && !envelope.loop) {
         length_counter--;
     }
 }
 
-APU::APU() : cycles(0) {}
+DmcChannel::DmcChannel()
+    : irq_enabled(false), loop(false), timer_period(dmc_rate_table[0]),
+      next_clock(0), output_level(0), sample_address(0xC000),
+      sample_length(1), current_address(0xC000), bytes_remaining(0),
+      shift_register(0), bits_remaining(8), silence(true), sample_buffer(0),
+      buffer_full(false), irq_flag(false), stall_cycles(0) {
+}
+
+void DmcChannel::write_register(uint8_t reg, uint8_t value) {
+    switch(reg) {
+        case 0:
+            irq_enabled = (value & 0x80) != 0;
+            loop = (value & 0x40) != 0;
+            timer_period = dmc_rate_table[value & 0x0F];
+            if (!irq_enabled) {
+                irq_flag = false;
+            }
+            break;
+        case 1:
+            output_level = value & 0x7F;
+            break;
+        case 2:
+            sample_address = 0xC000 + value * 64;
+            break;
+        case 3:
+            sample_length = value * 16 + 1;
+            break;
+    }
+}
+
+void DmcChannel::set_enabled(bool enabled) {
+    irq_flag = false;
+    if (!enabled) {
+        bytes_remaining = 0;
+    } else if (bytes_remaining == 0) {
+        current_address = sample_address;
+        bytes_remaining = sample_length;
+    }
+}
+
+bool DmcChannel::is_active() const {
+    return !silence || buffer_full || bytes_remaining > 0;
+}
+
+uint64_t DmcChannel::next_event() const {
+    return is_active() ? next_clock : APU_NO_EVENT;
+}
+
+void DmcChannel::fill_buffer(const Mem& memory) {
+    if (buffer_full || bytes_remaining == 0) {
+        return;
+    }
+    sample_buffer = memory.mem_read(current_address);
+    buffer_full = true;
+    stall_cycles += 4;
+    current_address = current_address == 0xFFFF ? 0x8000 : current_address + 1;
+    if (--bytes_remaining == 0) {
+        if (loop) {
+            current_address = sample_address;
+            bytes_remaining = sample_length;
+        } else if (irq_enabled) {
+            irq_flag = true;
+        }
+    }
+}
+
+void DmcChannel::clock_timer(const Mem& memory) {
+    if (!silence) {
+        if (shift_register & 1) {
+            if (output_level <= 125) {
+                output_level += 2;
+            }
+        } else if (output_level >= 2) {
+            output_level -= 2;
+        }
+        shift_register >>= 1;
+    }
+    if (--bits_remaining == 0) {
+        bits_remaining = 8;
+        silence = !buffer_full;
+        if (buffer_full) {
+            shift_register = sample_buffer;
+            buffer_full = false;
+        }
+    }
+    fill_buffer(memory);
+}
+
+// An idle DMC only cycles its bit counter, which is caught up in one step.
+void DmcChannel::advance_to(uint64_t cycle, const Mem& memory) {
+    while (cycle >= next_clock && is_active()) {
+        next_clock += timer_period;
+        clock_timer(memory);
+    }
+    if (cycle >= next_clock) {
+        uint64_t reloads = (cycle - next_clock) / timer_period + 1;
+        bits_remaining = 8 - (8 - bits_remaining + reloads) % 8;
+        next_clock += reloads * timer_period;
+    }
+}
+
+APU::APU()
+    : cycles(0)
+    , five_step_mode(false)
+    , irq_inhibit(false)
+    , frame_irq(false)
+    , frame_step(0)
+    , sequence_start(0)
+    , next_frame_event(four_step_sequence[0].cycle)
+    , sync_cycle(four_step_sequence[3].cycle)
+    , blip(CPU_CLOCK_RATE, 44100.0, 4096)
+    , frame_start(0)
+    , last_output(0.0f)
+    , output_muted(false)
+{}
 void APU::write_register(uint16_t addr, uint8_t value) {
     if (addr >= 0x4000 && addr <= 0x4003) {
         pulse1.write_register(addr - 0x4000, value);
     } else if (addr >= 0x4004 && addr <= 0x4007) {
         pulse2.write_register(addr - 0x4004, value);
+    } else if (addr >= 0x4008 && addr <= 0x400B) {
+        triangle.write_register(addr - 0x4008, value);
+    } else if (addr >= 0x400C && addr <= 0x400F) {
+        noise.write_register(addr - 0x400C, value);
+    } else if (addr >= 0x4010 && addr <= 0x4013) {
+        dmc.write_register(addr - 0x4010, value);
     } else if (addr == 0x4015) {
         pulse1.enabled = (value & 0x01) != 0;
         pulse2.enabled = (value & 0x02) != 0;
+        triangle.enabled = (value & 0x04) != 0;
+        noise.enabled = (value & 0x08) != 0;
         if (!pulse1.enabled) pulse1.length_counter = 0;
         if (!pulse2.enabled) pulse2.length_counter = 0;
+        if (!triangle.enabled) triangle.length_counter = 0;
+        if (!noise.enabled) noise.length_counter = 0;
+        dmc.set_enabled((value & 0x10) != 0);
     } else if (addr == 0x4017) {
-        // Frame counter control (we'll implement this later)
+        five_step_mode = (value & 0x80) != 0;
+        irq_inhibit = (value & 0x40) != 0;
+        if (irq_inhibit) {
+            frame_irq = false;
+        }
+        // The sequencer restarts 3 or 4 CPU cycles after the write, depending
+        // on whether it lands on an APU cycle. 5-step mode clocks all units
+        // immediately.
+        sequence_start = cycles + ((cycles & 1) ? 4 : 3);
+        frame_step = 0;
+        const FrameStep* sequence = five_step_mode ? five_step_sequence : four_step_sequence;
+        next_frame_event = sequence_start + sequence[0].cycle;
+        if (five_step_mode) {
+            clock_quarter_frame();
+            clock_half_frame();
+        }
+    }
+    update_output();
+    sync_cycle = compute_sync_cycle();
+}
+
+uint8_t APU::read_register(uint16_t addr) {
+    if (addr != 0x4015) {
+        return 0;
+    }
+    uint8_t status = 0;
+    if (pulse1.length_counter > 0) status |= 0x01;
+    if (pulse2.length_counter > 0) status |= 0x02;
+    if (triangle.length_counter > 0) status |= 0x04;
+    if (noise.length_counter > 0) status |= 0x08;
+    if (dmc.bytes_remaining > 0) status |= 0x10;
+    if (frame_irq) status |= 0x40;
+    if (dmc.irq_flag) status |= 0x80;
+    frame_irq = false;
+    sync_cycle = compute_sync_cycle();
+    return status;
+}
+
+void APU::run_until(uint64_t cycle, const Mem& memory) {
+    dmc.fill_buffer(memory);
+    while (cycles < cycle) {
+        uint64_t next = std::min({cycle, next_frame_event,
+                                  pulse1.next_event(), pulse2.next_event(),
+                                  triangle.next_event(), noise.next_event(),
+                                  dmc.next_event()});
+        cycles = next;
+        pulse1.advance_to(cycles);
+        pulse2.advance_to(cycles);
+        triangle.advance_to(cycles);
+        noise.advance_to(cycles);
+        dmc.advance_to(cycles, memory);
+        if (cycles == next_frame_event) {
+            clock_frame_sequencer();
+        }
+        update_output();
     }
+    sync_cycle = compute_sync_cycle();
 }
 
-void APU::clock() {
-    cycles++;
-    if (cycles % 2 == 0) {  
-        pulse1.clock_timer();
-        pulse2.clock_timer();
+void APU::clock_frame_sequencer() {
+    const FrameStep* sequence = five_step_mode ? five_step_sequence : four_step_sequence;
+    uint8_t steps = five_step_mode ? 5 : 4;
+    uint8_t clocks = sequence[frame_step].clocks;
+    if (clocks & QUARTER_FRAME) {
+        clock_quarter_frame();
+    }
+    if (clocks & HALF_FRAME) {
+        clock_half_frame();
     }
-    if (cycles % 7457 == 0) {  
-        pulse1.clock_envelope();
-        pulse2.clock_envelope();
+    if ((clocks & FRAME_IRQ) && !irq_inhibit) {
+        frame_irq = true;
+    }
+    if (++frame_step == steps) {
+        frame_step = 0;
+        sequence_start += sequence[steps].cycle;
+    }
+    next_frame_event = sequence_start + sequence[frame_step].cycle;
+}
+
+void APU::clock_quarter_frame() {
+    pulse1.clock_envelope();
+    pulse2.clock_envelope();
+    noise.envelope.clock();
+    triangle.clock_linear_counter();
+}
+
+void APU::clock_half_frame() {
+    pulse1.clock_length_counter();
+    pulse2.clock_length_counter();
+    triangle.clock_length_counter();
+    noise.clock_length_counter();
+    pulse1.clock_sweep(true);
+    pulse2.clock_sweep(false);
+}
+
+// A DMC fetch that is still pending must happen before the CPU runs on, and
+// the frame IRQ must be raised on the cycle the sequencer sets it.
+uint64_t APU::compute_sync_cycle() const {
+    if (!dmc.buffer_full && dmc.bytes_remaining > 0) {
+        return cycles;
     }
-    if (cycles % 14913 == 0) { 
-        pulse1.clock_length_counter();
-        pulse2.clock_length_counter();
+    uint64_t next = dmc.next_event();
+    if (!five_step_mode && !irq_inhibit && !frame_irq) {
+        next = std::min(next, sequence_start + four_step_sequence[3].cycle);
     }
+    return next;
 }
 
-float APU::output() {
-    float pulse_out = pulse1.output() + pulse2.output();
-    if (pulse_out == 0) return 0.0f;
-    return 0.00752f * pulse_out; 
-}
\ No newline at end of file
+uint8_t APU::take_stall_cycles() {
+    uint8_t stall = dmc.stall_cycles;
+    dmc.stall_cycles = 0;
+    return stall;
+}
+
+void APU::update_output() {
+    if (output_muted) {
+        return;
+    }
+    float level = output();
+    if (level != last_output) {
+        blip.add_delta(cycles - frame_start, level - last_output);
+        last_output = level;
+    }
+}
+
+void APU::end_frame() {
+    if (output_muted) {
+        return;
+    }
+    blip.end_frame(cycles - frame_start);
+    frame_start = cycles;
+}
+
+// Channels are written field by field: their padding bytes are
+// indeterminate and would make identical machines hash differently.
+void PulseChannel::save_state(StateWriter& out) const {
+    out.write(duty_cycle);
+    out.write(envelope);
+    out.write(sweep_enabled);
+    out.write(sweep_period);
+    out.write(sweep_negate);
+    out.write(sweep_shift);
+    out.write(sweep_divider);
+    out.write(sweep_reload);
+    out.write(timer_period);
+    out.write(next_clock);
+    out.write(length_counter);
+    out.write(enabled);
+    out.write(duty_sequence);
+}
+
+void PulseChannel::load_state(StateReader& in) {
+    in.read(duty_cycle);
+    in.read(envelope);
+    in.read(sweep_enabled);
+    in.read(sweep_period);
+    in.read(sweep_negate);
+    in.read(sweep_shift);
+    in.read(sweep_divider);
+    in.read(sweep_reload);
+    in.read(timer_period);
+    in.read(next_clock);
+    in.read(length_counter);
+    in.read(enabled);
+    in.read(duty_sequence);
+}
+
+void TriangleChannel::save_state(StateWriter& out) const {
+    out.write(control);
+    out.write(linear_reload);
+    out.write(linear_counter);
+    out.write(linear_reload_flag);
+    out.write(timer_period);
+    out.write(next_clock);
+    out.write(length_counter);
+    out.write(enabled);
+    out.write(sequence);
+}
+
+void TriangleChannel::load_state(StateReader& in) {
+    in.read(control);
+    in.read(linear_reload);
+    in.read(linear_counter);
+    in.read(linear_reload_flag);
+    in.read(timer_period);
+    in.read(next_clock);
+    in.read(length_counter);
+    in.read(enabled);
+    in.read(sequence);
+}
+
+void NoiseChannel::save_state(StateWriter& out) const {
+    out.write(envelope);
+    out.write(mode);
+    out.write(timer_period);
+    out.write(next_clock);
+    out.write(shift_register);
+    out.write(length_counter);
+    out.write(enabled);
+}
+
+void NoiseChannel::load_state(StateReader& in) {
+    in.read(envelope);
+    in.read(mode);
+    in.read(timer_period);
+    in.read(next_clock);
+    in.read(shift_register);
+    in.read(length_counter);
+    in.read(enabled);
+}
+
+void DmcChannel::save_state(StateWriter& out) const {
+    out.write(irq_enabled);
+    out.write(loop);
+    out.write(timer_period);
+    out.write(next_clock);
+    out.write(output_level);
+    out.write(sample_address);
+    out.write(sample_length);
+    out.write(current_address);
+    out.write(bytes_remaining);
+    out.write(shift_register);
+    out.write(bits_remaining);
+    out.write(silence);
+    out.write(sample_buffer);
+    out.write(buffer_full);
+    out.write(irq_flag);
+    out.write(stall_cycles);
+}
+
+void DmcChannel::load_state(StateReader& in) {
+    in.read(irq_enabled);
+    in.read(loop);
+    in.read(timer_period);
+    in.read(next_clock);
+    in.read(output_level);
+    in.read(sample_address);
+    in.read(sample_length);
+    in.read(current_address);
+    in.read(bytes_remaining);
+    in.read(shift_register);
+    in.read(bits_remaining);
+    in.read(silence);
+    in.read(sample_buffer);
+    in.read(buffer_full);
+    in.read(irq_flag);
+    in.read(stall_cycles);
+}
+
+void APU::save_state(StateWriter& out) const {
+    out.begin_chunk("APU ", 2);
+    pulse1.save_state(out);
+    pulse2.save_state(out);
+    triangle.save_state(out);
+    noise.save_state(out);
+    dmc.save_state(out);
+    out.write(cycles);
+    out.write(five_step_mode);
+    out.write(irq_inhibit);
+    out.write(frame_irq);
+    out.write(frame_step);
+    out.write(sequence_start);
+    out.write(next_frame_event);
+    out.end_chunk();
+}
+
+// The resampler keeps its own clock relative to frame_start and its own
+// output level, so both are carried over rather than restored: the jump
+// in level is then synthesized like any other change. While muted neither
+// has moved since the state was saved, so they are left as they are.
+void APU::load_state(StateReader& in) {
+    if (in.open_chunk("APU ") != 2) {
+        throw StateError("Unsupported APU state version");
+    }
+    uint64_t blip_time = cycles - frame_start;
+    pulse1.load_state(in);
+    pulse2.load_state(in);
+    triangle.load_state(in);
+    noise.load_state(in);
+    dmc.load_state(in);
+    in.read(cycles);
+    in.read(five_step_mode);
+    in.read(irq_inhibit);
+    in.read(frame_irq);
+    in.read(frame_step);
+    in.read(sequence_start);
+    in.read(next_frame_event);
+    in.close_chunk();
+    if (output_muted) {
+        sync_cycle = compute_sync_cycle();
+        return;
+    }
+    frame_start = cycles - std::min(blip_time, cycles);
+    sync_cycle = compute_sync_cycle();
+    update_output();
+}
+
+void APU::set_sample_rate(double rate) {
+    blip.set_rates(CPU_CLOCK_RATE, rate);
+    blip.clear();
+}
+
+float APU::output() const {
+    int pulse_out = pulse1.output() + pulse2.output();
+    int tnd_out = 3 * triangle.output() + 2 * noise.output() + dmc.output();
+    return mixer.pulse[pulse_out] + mixer.tnd[tnd_out];
+}
@@ -0,0 +1,54 @@
+#include "audio/audio_sync.h"
+#include <algorithm>
+#include <stdexcept>
+
+AudioSync::AudioSync(double sample_rate, double latency_ms)
+    : buffer(static_cast<size_t>(sample_rate * latency_ms / 1000.0) * 4 + 4096)
+    , target_fill(static_cast<size_t>(sample_rate * latency_ms / 1000.0))
+    , average_fill(static_cast<double>(target_fill))
+    , ratio(1.0)
+    , last_sample(0.0f)
+    , underruns(0)
+    , dropped(0)
+{
+    if (target_fill == 0) {
+        throw std::invalid_argument("Audio latency is too small for the sample rate");
+    }
+}
+
+void AudioSync::push(const float* samples, size_t count) {
+    size_t written = buffer.write(samples, count);
+    if (written < count) {
+        dropped.fetch_add(count - written, std::memory_order_relaxed);
+    }
+}
+
+// The fill level jumps by a whole frame on every push and by a device
+// period on every pull, so it is smoothed before steering the ratio.
+double AudioSync::update_rate_ratio() {
+    average_fill += (static_cast<double>(buffer.size()) - average_fill) * 0.05;
+    double error = (static_cast<double>(target_fill) - average_fill) / target_fill;
+    ratio = 1.0 + MAX_RATE_ADJUST * std::clamp(error, -1.0, 1.0);
+    return ratio;
+}
+
+AudioMetrics AudioSync::metrics() const {
+    return AudioMetrics{
+        buffer.size(),
+        target_fill,
+        underruns.load(std::memory_order_relaxed),
+        dropped.load(std::memory_order_relaxed),
+        ratio
+    };
+}
+
+void AudioSync::pull(float* out, size_t count) {
+    size_t n = buffer.read(out, count);
+    if (n > 0) {
+        last_sample = out[n - 1];
+    }
+    if (n < count) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        std::fill(out + n, out + count, last_sample);
+    }
+}
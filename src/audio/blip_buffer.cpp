@@ -0,0 +1,110 @@
+#include "audio/blip_buffer.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+// Fraction of Nyquist kept by the kernel; the rest is the transition band.
+constexpr double CUTOFF = 0.9;
+// One-pole DC blocker, roughly where the NES output's first high-pass sits.
+constexpr double BASS_HZ = 20.0;
+
+} // namespace
+
+BlipBuffer::BlipBuffer(double clock_rate, double sample_rate, size_t capacity)
+    : kernel{}
+    , buffer(capacity + TAPS, 0.0f)
+    , factor(0)
+    , offset(0)
+    , clock_rate(0)
+    , sample_rate(0)
+    , integrator(0.0f)
+    , bass_leak(0.0f)
+{
+    // Row p is the band-limited impulse for a step landing p/PHASES of a
+    // sample after the row start, delayed by TAPS/2 samples. Each row is
+    // normalised to sum to 1 so a delta integrates to exactly its height.
+    for (size_t p = 0; p < PHASES; p++) {
+        double sum = 0.0;
+        std::array<double, TAPS> row{};
+        for (size_t k = 0; k < TAPS; k++) {
+            double x = static_cast<double>(k) - TAPS / 2.0 - static_cast<double>(p) / PHASES;
+            double sinc = x == 0.0 ? 1.0 : std::sin(PI * CUTOFF * x) / (PI * CUTOFF * x);
+            double w = (x + TAPS / 2.0) / TAPS;
+            double window = 0.42 - 0.5 * std::cos(2 * PI * w) + 0.08 * std::cos(4 * PI * w);
+            row[k] = sinc * window;
+            sum += row[k];
+        }
+        for (size_t k = 0; k < TAPS; k++) {
+            kernel[p][k] = static_cast<float>(row[k] / sum);
+        }
+    }
+    set_rates(clock_rate, sample_rate);
+}
+
+void BlipBuffer::set_rates(double clock_rate, double sample_rate) {
+    if (clock_rate <= 0 || sample_rate <= 0 || sample_rate > clock_rate) {
+        throw std::invalid_argument("BlipBuffer needs 0 < sample rate <= clock rate");
+    }
+    this->clock_rate = clock_rate;
+    this->sample_rate = sample_rate;
+    factor = static_cast<uint64_t>(std::ldexp(sample_rate / clock_rate, 32) + 0.5);
+    bass_leak = static_cast<float>(1.0 - std::exp(-2.0 * PI * BASS_HZ / sample_rate));
+}
+
+void BlipBuffer::add_delta(uint64_t clock_time, float delta) {
+    uint64_t pos = offset + clock_time * factor;
+    size_t index = static_cast<size_t>(pos >> 32);
+    if (index + TAPS > buffer.size()) {
+        return;  // nobody is reading; drop rather than overrun
+    }
+    const float* k = kernel[(pos >> (32 - PHASE_BITS)) & (PHASES - 1)].data();
+    float* out = &buffer[index];
+#if defined(__SSE__)
+    __m128 d = _mm_set1_ps(delta);
+    for (size_t i = 0; i < TAPS; i += 4) {
+        __m128 acc = _mm_loadu_ps(out + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(acc, _mm_mul_ps(d, _mm_load_ps(k + i))));
+    }
+#else
+    for (size_t i = 0; i < TAPS; i++) {
+        out[i] += delta * k[i];
+    }
+#endif
+}
+
+void BlipBuffer::end_frame(uint64_t clock_duration) {
+    offset += clock_duration * factor;
+    size_t limit = buffer.size() - TAPS;
+    if (samples_avail() > limit) {
+        offset = (offset & 0xFFFFFFFFull) | (static_cast<uint64_t>(limit) << 32);
+    }
+}
+
+size_t BlipBuffer::read_samples(float* out, size_t count) {
+    size_t n = std::min(count, samples_avail());
+    float sum = integrator;
+    for (size_t i = 0; i < n; i++) {
+        sum += buffer[i];
+        out[i] = sum;
+        sum -= sum * bass_leak;
+    }
+    integrator = sum;
+    // Keep the unread samples plus the kernel tails that overhang them.
+    size_t keep = samples_avail() - n + TAPS;
+    std::copy(buffer.begin() + n, buffer.begin() + n + keep, buffer.begin());
+    std::fill(buffer.begin() + keep, buffer.begin() + n + keep, 0.0f);
+    offset -= static_cast<uint64_t>(n) << 32;
+    return n;
+}
+
+void BlipBuffer::clear() {
+    std::fill(buffer.begin(), buffer.end(), 0.0f);
+    offset = 0;
+    integrator = 0.0f;
+}
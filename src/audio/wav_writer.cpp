@@ -0,0 +1,136 @@
+#include "audio/wav_writer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+}
+
+void put_u32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+size_t bytes_per_sample(WavFormat format) {
+    return format == WavFormat::Pcm16 ? 2 : 4;
+}
+
+}
+
+WavWriter::WavWriter(const std::string& path, uint32_t sample_rate, WavFormat format)
+    : file(std::fopen(path.c_str(), "wb"))
+    , format(format)
+    , sample_rate(sample_rate)
+    , data_bytes(0)
+    , buffer(BUFFER_SIZE)
+    , buffer_used(0)
+{
+    if (!file) {
+        throw std::runtime_error("Could not open WAV file: " + path);
+    }
+    write_header();
+}
+
+WavWriter::~WavWriter() {
+    try {
+        close();
+    } catch (const std::exception&) {
+    }
+}
+
+// Sizes are placeholders until close(); a float file also needs the
+// extended fmt chunk and a fact chunk to be strictly valid.
+void WavWriter::write_header() {
+    uint8_t header[58] = {};
+    bool is_float = format == WavFormat::Float32;
+    uint32_t block_align = static_cast<uint32_t>(bytes_per_sample(format));
+    uint32_t frames = static_cast<uint32_t>(data_bytes / block_align);
+    uint32_t data_size = static_cast<uint32_t>(std::min<uint64_t>(data_bytes, 0xFFFFFFFFu - 58));
+    size_t header_size = is_float ? 58 : 44;
+    std::memcpy(header, "RIFF", 4);
+    put_u32(header + 4, static_cast<uint32_t>(header_size - 8 + data_size));
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32(header + 16, is_float ? 18 : 16);
+    put_u16(header + 20, is_float ? 3 : 1);
+    put_u16(header + 22, 1);
+    put_u32(header + 24, sample_rate);
+    put_u32(header + 28, sample_rate * block_align);
+    put_u16(header + 32, block_align);
+    put_u16(header + 34, block_align * 8);
+    uint8_t* data_chunk = header + 36;
+    if (is_float) {
+        put_u16(header + 36, 0);
+        std::memcpy(header + 38, "fact", 4);
+        put_u32(header + 42, 4);
+        put_u32(header + 46, frames);
+        data_chunk = header + 50;
+    }
+    std::memcpy(data_chunk, "data", 4);
+    put_u32(data_chunk + 4, data_size);
+    if (std::fwrite(header, 1, header_size, file) != header_size) {
+        throw std::runtime_error("Failed to write WAV header");
+    }
+}
+
+void WavWriter::write(const float* samples, size_t count) {
+    if (!file) {
+        throw std::logic_error("WAV file is already closed");
+    }
+    size_t size = bytes_per_sample(format);
+    for (size_t i = 0; i < count; i++) {
+        if (buffer_used + size > BUFFER_SIZE) {
+            flush();
+        }
+        uint8_t* out = &buffer[buffer_used];
+        if (format == WavFormat::Pcm16) {
+            float scaled = std::clamp(samples[i], -1.0f, 1.0f) * 32767.0f;
+            put_u16(out, static_cast<uint16_t>(static_cast<int16_t>(std::lround(scaled))));
+        } else {
+            uint32_t bits;
+            std::memcpy(&bits, &samples[i], 4);
+            put_u32(out, bits);
+        }
+        buffer_used += size;
+    }
+}
+
+void WavWriter::flush() {
+    if (buffer_used == 0) {
+        return;
+    }
+    if (std::fwrite(buffer.data(), 1, buffer_used, file) != buffer_used) {
+        throw std::runtime_error("Failed to write WAV data");
+    }
+    data_bytes += buffer_used;
+    buffer_used = 0;
+}
+
+void WavWriter::close() {
+    if (!file) {
+        return;
+    }
+    std::FILE* f = file;
+    try {
+        flush();
+        std::rewind(file);
+        write_header();
+    } catch (...) {
+        file = nullptr;
+        std::fclose(f);
+        throw;
+    }
+    file = nullptr;
+    if (std::fclose(f) != 0) {
+        throw std::runtime_error("Failed to close WAV file");
+    }
+}
+
+uint64_t WavWriter::samples_written() const {
+    return (data_bytes + buffer_used) / bytes_per_sample(format);
+}
@@ -0,0 +1,318 @@
+#include "emulator.h"
+#include "hash.h"
+#include "movie.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: nes-emu-batch [options] [ROM...]\n"
+              << "  --jobs FILE    one job per line: ROM [frames=N] [seed=N] [movie=FILE]\n"
+              << "  --frames N     frames per job (default 600, or the movie's length)\n"
+              << "  --seeds N      run each ROM on the command line with seeds 1..N\n"
+              << "  --threads N    worker threads (default: all cores)\n"
+              << "  --scaling      time the batch at 1, 2, 4, ... threads instead\n"
+              << "\n"
+              << "Every job runs its own emulator from power-on. Seed 0 presses no\n"
+              << "buttons; other seeds press random ones, the same for the same seed.\n"
+              << "Results are printed as JSON lines in completion order.\n";
+}
+
+struct BatchJob {
+    std::string rom;
+    std::string movie;
+    uint64_t frames;
+    bool frames_given;
+    uint32_t seed;
+};
+
+struct BatchResult {
+    double seconds;
+    uint64_t frames;
+    std::string state_sha1;
+    std::string error;
+};
+
+std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+std::vector<BatchJob> read_jobs(const std::string& path, uint64_t default_frames, bool frames_given) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    std::vector<BatchJob> jobs;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        BatchJob job = {"", "", default_frames, frames_given, 0};
+        if (!(fields >> job.rom)) {
+            continue;
+        }
+        std::string field;
+        while (fields >> field) {
+            size_t equals = field.find('=');
+            std::string key = field.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+            if (key == "frames" && !value.empty()) {
+                job.frames = std::stoull(value);
+                job.frames_given = true;
+            } else if (key == "seed" && !value.empty()) {
+                job.seed = static_cast<uint32_t>(std::stoul(value));
+            } else if (key == "movie" && !value.empty()) {
+                job.movie = value;
+            } else {
+                throw std::runtime_error(path + ":" + std::to_string(line_number) + ": unknown field '" + field + "'");
+            }
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// Holds each random button mask for a random 4..31 frames.
+class RandomInput {
+public:
+    explicit RandomInput(uint32_t seed) : random(seed), mask(0), frames_left(0) {}
+    uint8_t next() {
+        if (frames_left == 0) {
+            mask = static_cast<uint8_t>(random());
+            frames_left = 4 + random() % 28;
+        }
+        frames_left--;
+        return mask;
+    }
+private:
+    std::mt19937 random;
+    uint8_t mask;
+    uint32_t frames_left;
+};
+
+BatchResult run_job(const BatchJob& job, const std::shared_ptr<const RomImage>& image, const Movie* movie) {
+    BatchResult result = {0.0, 0, "", ""};
+    auto start = std::chrono::steady_clock::now();
+    try {
+        Emulator emulator;
+        emulator.set_render_enabled(false);
+        emulator.load_rom(image);
+        if (movie && movie->rom_crc32 != 0 && movie->rom_crc32 != emulator.rom_crc()) {
+            throw std::runtime_error("Movie was recorded on a different ROM");
+        }
+        uint64_t frames = job.frames;
+        if (movie && !job.frames_given) {
+            frames = movie->frames.size();
+        }
+        RandomInput random(job.seed);
+        for (uint64_t frame = 0; frame < frames; frame++) {
+            MovieFrame step = {};
+            if (movie) {
+                if (frame < movie->frames.size()) {
+                    step = movie->frames[frame];
+                }
+            } else if (job.seed != 0) {
+                step.pads[0] = random.next();
+            }
+            play_movie_frame(emulator, step);
+        }
+        std::vector<uint8_t> state(emulator.state_size());
+        emulator.save_state(state);
+        result.frames = frames;
+        result.state_sha1 = to_hex(sha1(state));
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::string result_json(size_t index, const BatchJob& job, const BatchResult& result) {
+    std::ostringstream out;
+    out << "{\"job\":" << index
+        << ",\"rom\":" << json_string(job.rom)
+        << ",\"seed\":" << job.seed
+        << ",\"movie\":" << (job.movie.empty() ? "null" : json_string(job.movie))
+        << ",\"frames\":" << result.frames
+        << ",\"seconds\":" << result.seconds
+        << ",\"fps\":" << (result.seconds > 0 ? result.frames / result.seconds : 0.0);
+    if (result.error.empty()) {
+        out << ",\"state_sha1\":\"" << result.state_sha1 << "\"";
+    } else {
+        out << ",\"error\":" << json_string(result.error);
+    }
+    out << "}";
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> roms;
+    std::string jobs_path;
+    uint64_t frames = 600;
+    bool frames_given = false;
+    uint32_t seeds = 0;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool scaling = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) {
+            jobs_path = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::stoull(argv[++i]);
+            frames_given = true;
+        } else if (arg == "--seeds" && i + 1 < argc) {
+            seeds = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--scaling") {
+            scaling = true;
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            roms.push_back(arg);
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    try {
+        std::vector<BatchJob> jobs;
+        if (!jobs_path.empty()) {
+            jobs = read_jobs(jobs_path, frames, frames_given);
+        }
+        for (const auto& rom : roms) {
+            for (uint32_t seed = seeds > 0 ? 1 : 0; seed <= seeds; seed++) {
+                jobs.push_back({rom, "", frames, frames_given, seed});
+            }
+        }
+        if (jobs.empty()) {
+            print_usage();
+            return 1;
+        }
+
+        // Jobs on the same ROM share one mapping, and movies are read once.
+        // Files that cannot be read fail only the jobs that use them.
+        std::map<std::string, std::shared_ptr<const RomImage>> images;
+        std::map<std::string, std::string> rom_errors;
+        std::map<std::string, Movie> movies;
+        std::map<std::string, std::string> movie_errors;
+        for (const auto& job : jobs) {
+            if (!images.count(job.rom) && !rom_errors.count(job.rom)) {
+                try {
+                    images[job.rom] = RomImage::map_file(job.rom);
+                } catch (const std::exception& e) {
+                    rom_errors[job.rom] = e.what();
+                }
+            }
+            if (!job.movie.empty() && !movies.count(job.movie) && !movie_errors.count(job.movie)) {
+                try {
+                    movies[job.movie] = Movie::load(job.movie);
+                } catch (const std::exception& e) {
+                    movie_errors[job.movie] = e.what();
+                }
+            }
+        }
+        auto run = [&](size_t index) {
+            const BatchJob& job = jobs[index];
+            if (rom_errors.count(job.rom)) {
+                return BatchResult{0.0, 0, "", rom_errors.at(job.rom)};
+            }
+            if (movie_errors.count(job.movie)) {
+                return BatchResult{0.0, 0, "", movie_errors.at(job.movie)};
+            }
+            const Movie* movie = job.movie.empty() ? nullptr : &movies.at(job.movie);
+            return run_job(job, images.at(job.rom), movie);
+        };
+
+        if (!scaling) {
+            ThreadPool pool(threads);
+            std::mutex output;
+            bool failed = false;
+            pool.parallel_for(jobs.size(), [&](size_t index) {
+                BatchResult result = run(index);
+                std::string line = result_json(index, jobs[index], result);
+                std::lock_guard<std::mutex> lock(output);
+                std::cout << line << "\n";
+                failed |= !result.error.empty();
+            });
+            std::cout.flush();
+            return failed ? 1 : 0;
+        }
+
+        // Each emulator is independent, so throughput should grow with the
+        // thread count until the cores run out.
+        double single_thread_fps = 0.0;
+        for (size_t count = 1;; count = std::min(count * 2, threads)) {
+            ThreadPool pool(count);
+            std::vector<uint64_t> frames_run(jobs.size());
+            auto start = std::chrono::steady_clock::now();
+            pool.parallel_for(jobs.size(), [&](size_t index) {
+                frames_run[index] = run(index).frames;
+            });
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            uint64_t total = 0;
+            for (uint64_t f : frames_run) {
+                total += f;
+            }
+            double fps = total / seconds;
+            if (count == 1) {
+                single_thread_fps = fps;
+            }
+            double speedup = fps / single_thread_fps;
+            std::cout << "{\"threads\":" << count
+                      << ",\"jobs\":" << jobs.size()
+                      << ",\"frames\":" << total
+                      << ",\"seconds\":" << seconds
+                      << ",\"fps\":" << fps
+                      << ",\"speedup\":" << speedup
+                      << ",\"efficiency\":" << speedup / count << "}" << std::endl;
+            if (count == threads) {
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,21 +1,69 @@
 #include "bus.h"
-#include <iostream>
 #include <stdexcept>
 
+namespace {
+
+// Blocks of the Bus's state arena.
+enum ArenaBlock : size_t {
+    CPU_RAM_BLOCK,
+    VRAM_BLOCK,
+    OAM_BLOCK,
+    PALETTE_BLOCK,
+    CHR_RAM_BLOCK
+};
+
+}
+
 Bus::Bus(Rom rom, std::function<void(const NesPPU&, Joypad&)> callback)
-    : cpu_vram{}
-    , prg_rom(std::move(rom.prg_rom))
-    , ppu(std::make_unique<NesPPU>(std::move(rom.chr_rom), rom.screen_mirroring))
+    : arena({2048, NesPPU::VRAM_SIZE, NesPPU::OAM_SIZE, NesPPU::PALETTE_SIZE,
+             Mapper::chr_ram_size(rom)})
+    , cpu_vram(arena.block<2048>(CPU_RAM_BLOCK))
+    , mapper(make_mapper(std::move(rom), arena.block(CHR_RAM_BLOCK)))
+    , ppu(mapper.get(), mapper->mirroring,
+          arena.block<NesPPU::VRAM_SIZE>(VRAM_BLOCK),
+          arena.block<NesPPU::OAM_SIZE>(OAM_BLOCK),
+          arena.block<NesPPU::PALETTE_SIZE>(PALETTE_BLOCK))
+    , apu()
+    , cycles(0)
     , gameloop_callback(std::move(callback))
     , joypad()
+    , joypad2()
+    , frame_complete(false)
+    , ppu_enabled(true)
 {}
 
-uint8_t Bus::read_prg_rom(uint16_t addr) const {
-    addr -= 0x8000;
-    if (prg_rom.size() == 0x4000 && addr >= 0x4000) {
-        addr = addr % 0x4000;
+void Bus::save_state(StateWriter& out) const {
+    out.begin_chunk("ARNA", 1);
+    out.write_bytes(arena.data(), arena.size());
+    out.end_chunk();
+    out.begin_chunk("BUS ", 3);
+    out.write(cycles);
+    out.write(frame_complete);
+    out.write(joypad);
+    out.write(joypad2);
+    out.end_chunk();
+    ppu.save_state(out);
+    apu.save_state(out);
+    mapper->save_state(out);
+}
+
+void Bus::load_state(StateReader& in) {
+    if (in.open_chunk("ARNA") != 1) {
+        throw StateError("Unsupported arena state version");
     }
-    return prg_rom[addr];
+    in.read_bytes(arena.bytes().data(), arena.size());
+    in.close_chunk();
+    if (in.open_chunk("BUS ") != 3) {
+        throw StateError("Unsupported BUS state version");
+    }
+    in.read(cycles);
+    in.read(frame_complete);
+    in.read(joypad);
+    in.read(joypad2);
+    in.close_chunk();
+    ppu.load_state(in);
+    apu.load_state(in);
+    mapper->load_state(in);
 }
 
 uint8_t Bus::mem_read(uint16_t addr) const {
@@ -23,29 +71,40 @@ uint8_t Bus::mem_read(uint16_t addr) const {
         uint16_t mirror_down_addr = addr & 0x07FF;
         return cpu_vram[mirror_down_addr];
 
+    } else if (addr >= 0x8000) {
+        // Opcode fetches dominate, so cartridge space is tested early.
+        return mapper->read_prg(addr);
+
+    } else if (addr >= 0x6000) {
+        return mapper->read_prg_ram(addr);
+
     } else if (addr == 0x2000 || addr == 0x2001 || addr == 0x2003 || 
                addr == 0x2005 || addr == 0x2006 || addr == 0x4014) {
         // std::cout << "Warning: Read from write-only PPU address 0x" << std::hex << addr << std::dec << std::endl;
         return 0;
         
     } else if (addr == 0x2002) {
-        return ppu->read_status();
+        return ppu.read_status();
         
     } else if (addr == 0x2004) {
-        return ppu->read_oam_data();
+        return ppu.read_oam_data();
         
     } else if (addr == 0x2007) {
-        return ppu->read_data();
+        return ppu.read_data();
         
     } else if (addr >= 0x2008 && addr <= PPU_REGISTERS_MIRRORS_END) {
         uint16_t mirror_down_addr = addr & 0x2007;
         return mem_read(mirror_down_addr);
         
-    } else if (addr >= 0x8000 && addr <= 0xFFFF) {
-        return read_prg_rom(addr);
-    
+    } else if (addr == 0x4015) {
+        apu.run_until(cycles, *this);
+        return apu.read_register(addr);
+
     } else if (addr == 0x4016) {
         return joypad.read();
+
+    } else if (addr == 0x4017) {
+        return joypad2.read();
         
     } else {
         return 0;
@@ -58,57 +117,79 @@ void Bus::mem_write(uint16_t addr, uint8_t data) {
         cpu_vram[mirror_down_addr] = data;
         
     } else if (addr == 0x2000) {
-        ppu->write_to_ctrl(data);
+        ppu.write_to_ctrl(data);
         
     } else if (addr == 0x2001) {
-        ppu->write_to_mask(data);
+        ppu.write_to_mask(data);
         
     } else if (addr == 0x2002) {
         // throw std::runtime_error("Attempt to write to PPU status register");
         
     } else if (addr == 0x2003) {
-        ppu->write_to_oam_addr(data);
+        ppu.write_to_oam_addr(data);
         
     } else if (addr == 0x2004) {
-        ppu->write_to_oam_data(data);
+        ppu.write_to_oam_data(data);
 
     } else if (addr == 0x4014) {
         uint16_t start = static_cast<uint16_t>(data) << 8;
         for (int i = 0; i < 256; i++) {
-            ppu->oam_data[ppu->oam_addr] = mem_read(start + i);
-            ppu->oam_addr++;
+            ppu.oam_data[ppu.oam_addr] = mem_read(start + i);
+            ppu.oam_addr++;
         }
         
     } else if (addr == 0x2005) {
-        ppu->write_to_scroll(data);
+        ppu.write_to_scroll(data);
         
     } else if (addr == 0x2006) {
-        ppu->write_to_ppu_addr(data);
+        ppu.write_to_ppu_addr(data);
         
     } else if (addr == 0x2007) {
-        ppu->write_to_data(data);
+        ppu.write_to_data(data);
         
     } else if (addr >= 0x2008 && addr <= PPU_REGISTERS_MIRRORS_END) {
         uint16_t mirror_down_addr = addr & 0x2007;
         mem_write(mirror_down_addr, data);
         
-    } else if (addr >= 0x8000 && addr <= 0xFFFF) {
-        // throw std::runtime_error("Attempt to write to Cartridge ROM space");
+    } else if (addr >= 0x6000 && addr < 0x8000) {
+        mapper->write_prg_ram(addr, data);
+
+    } else if (addr >= 0x4020 && addr < 0x6000) {
+        mapper->write_expansion(addr, data);
+
+    } else if (addr >= 0x8000) {
+        mapper->write_register(addr, data);
+        if (mapper->mirroring != ppu.mirroring) {
+            ppu.set_mirroring(mapper->mirroring);
+        }
+
+    } else if ((addr >= 0x4000 && addr <= 0x4013) || addr == 0x4015 || addr == 0x4017) {
+        apu.run_until(cycles, *this);
+        apu.write_register(addr, data);
 
     } else if (addr == 0x4016) {
         joypad.write(data);
+        joypad2.write(data);
     }
 
 }
 
 void Bus::tick(uint8_t cpu_cycles) {
-    bool vblank_entered = ppu->tick(cpu_cycles * 3);
+    cycles += cpu_cycles;
+    // DMC sample fetches steal cycles from the CPU, which the PPU must see.
+    if (cycles >= apu.next_sync_cycle()) {
+        apu.run_until(cycles, *this);
+        uint8_t stall = apu.take_stall_cycles();
+        cycles += stall;
+        cpu_cycles += stall;
+    }
+    bool vblank_entered = ppu_enabled && ppu.tick(cpu_cycles * 3);
     if (vblank_entered) {
-        static int frame_count = 0;
-        frame_count++;
-        if (frame_count % 60 == 0) {
-            std::cout << "Frame " << frame_count << std::endl;
+        apu.run_until(cycles, *this);
+        apu.end_frame();
+        frame_complete = true;
+        if (gameloop_callback) {
+            gameloop_callback(ppu, joypad);
         }
-        gameloop_callback(*ppu, joypad);
     }
 }
\ No newline at end of file
@@ -1,15 +1,54 @@
 #include "cartridge.h"
+#include <algorithm>
 #include <cstring>  
 
-Rom::Rom(std::vector<uint8_t> prg, std::vector<uint8_t> chr, 
-         uint8_t map, Mirroring mirror)
-    : prg_rom(std::move(prg))
-    , chr_rom(std::move(chr))
+Rom::Rom(std::shared_ptr<const RomImage> owner, std::span<const uint8_t> prg,
+         std::span<const uint8_t> chr, uint16_t map, Mirroring mirror)
+    : image(std::move(owner))
+    , prg_rom(prg)
+    , chr_rom(chr)
     , mapper(map)
+    , submapper(0)
     , screen_mirroring(mirror)
+    , prg_ram_size(PRG_RAM_PAGE_SIZE)
+    , prg_nvram_size(0)
+    , chr_ram_size(chr_rom.empty() ? CHR_ROM_PAGE_SIZE : 0)
+    , chr_nvram_size(0)
+    , battery(false)
+    , nes2(false)
+    , timing(Timing::Ntsc)
+    , console_type(ConsoleType::Nes)
 {}
 
+namespace {
+
+// NES 2.0 ROM sizes: a 12-bit page count, or when the high nibble is $F,
+// 2^E * (2M+1) bytes packed into the low byte.
+size_t nes2_rom_size(uint8_t lsb, uint8_t msb_nibble, size_t page_size) {
+    if (msb_nibble == 0x0F) {
+        size_t exponent = lsb >> 2;
+        size_t multiplier = (lsb & 0b11) * 2 + 1;
+        if (exponent > 40) {
+            throw RomParseError("NES 2.0 ROM size is out of range");
+        }
+        return (size_t(1) << exponent) * multiplier;
+    }
+    return ((static_cast<size_t>(msb_nibble) << 8) | lsb) * page_size;
+}
+
+// NES 2.0 RAM sizes are shift counts: 64 << n bytes, with 0 meaning none.
+size_t nes2_ram_size(uint8_t shift) {
+    return shift == 0 ? 0 : size_t(64) << shift;
+}
+
+}
+
 Rom Rom::create(const std::vector<uint8_t>& raw) {
+    return create(RomImage::from_bytes(raw));
+}
+
+Rom Rom::create(std::shared_ptr<const RomImage> image) {
+    std::span<const uint8_t> raw = image->span();
     if (raw.size() < 16) {
         throw RomParseError("File too small to be a valid ROM");
     }
@@ -17,11 +56,19 @@ Rom Rom::create(const std::vector<uint8_t>& raw) {
         throw RomParseError("Invalid NES file header");
     }
     
-    uint8_t mapper = (raw[7] & 0b11110000) | (raw[6] >> 4);
     uint8_t ines_ver = (raw[7] >> 2) & 0b11;
-    if (ines_ver != 0) {
+    bool nes2 = ines_ver == 2;
+    if (ines_ver == 3) {
         throw RomParseError("Unsupported iNES version");
     }
+    // Old rippers' tags ("DiskDude!") fill bytes 7-15 of many iNES 1.0
+    // headers. As in other emulators, a header with anything in bytes 12-15
+    // (or the reserved version 1) only keeps bytes 4-6.
+    bool dirty = !nes2 && (ines_ver == 1 || raw[12] != 0 || raw[13] != 0 || raw[14] != 0 || raw[15] != 0);
+    uint16_t mapper = (dirty ? 0 : (raw[7] & 0b11110000)) | (raw[6] >> 4);
+    if (nes2) {
+        mapper |= static_cast<uint16_t>(raw[8] & 0x0F) << 8;
+    }
     
     bool four_screen = (raw[6] & 0b00001000) != 0;
     bool vertical_mirroring = (raw[6] & 0b00000001) != 0;
@@ -34,8 +81,12 @@ Rom Rom::create(const std::vector<uint8_t>& raw) {
         screen_mirroring = Mirroring::Horizontal;
     }
     
-    size_t prg_rom_size = raw[4] * PRG_ROM_PAGE_SIZE;
-    size_t chr_rom_size = raw[5] * CHR_ROM_PAGE_SIZE; 
+    size_t prg_rom_size = nes2
+        ? nes2_rom_size(raw[4], raw[9] & 0x0F, PRG_ROM_PAGE_SIZE)
+        : raw[4] * PRG_ROM_PAGE_SIZE;
+    size_t chr_rom_size = nes2
+        ? nes2_rom_size(raw[5], raw[9] >> 4, CHR_ROM_PAGE_SIZE)
+        : raw[5] * CHR_ROM_PAGE_SIZE; 
     bool skip_trainer = (raw[6] & 0b00000100) != 0;
     size_t prg_rom_start = 16 + (skip_trainer ? 512 : 0);
     size_t chr_rom_start = prg_rom_start + prg_rom_size;
@@ -43,20 +94,106 @@ Rom Rom::create(const std::vector<uint8_t>& raw) {
     if (raw.size() < chr_rom_start + chr_rom_size) {
         throw RomParseError("ROM data is incomplete"); 
     }
-    std::vector<uint8_t> prg_rom(
-        raw.begin() + prg_rom_start,
-        raw.begin() + prg_rom_start + prg_rom_size
-    );
-    
-    std::vector<uint8_t> chr_rom(
-        raw.begin() + chr_rom_start,
-        raw.begin() + chr_rom_start + chr_rom_size
-    );
-
-    return Rom(
-        std::move(prg_rom),
-        std::move(chr_rom),
+    Rom rom(
+        std::move(image),
+        raw.subspan(prg_rom_start, prg_rom_size),
+        raw.subspan(chr_rom_start, chr_rom_size),
         mapper,
         screen_mirroring
     );
-}
\ No newline at end of file
+    rom.battery = (raw[6] & 0b00000010) != 0;
+    rom.nes2 = nes2;
+    if (nes2) {
+        rom.submapper = raw[8] >> 4;
+        rom.prg_ram_size = nes2_ram_size(raw[10] & 0x0F);
+        rom.prg_nvram_size = nes2_ram_size(raw[10] >> 4);
+        rom.chr_ram_size = nes2_ram_size(raw[11] & 0x0F);
+        rom.chr_nvram_size = nes2_ram_size(raw[11] >> 4);
+        rom.timing = static_cast<Timing>(raw[12] & 0b11);
+        rom.console_type = static_cast<ConsoleType>(raw[7] & 0b11);
+    } else if (!dirty) {
+        // Byte 8 counts 8 KB PRG-RAM pages; 0 means one for compatibility.
+        rom.prg_ram_size = std::max<size_t>(raw[8], 1) * PRG_RAM_PAGE_SIZE;
+    }
+    return rom;
+}
+
+namespace {
+
+std::string header_string(std::span<const uint8_t> raw, size_t offset) {
+    size_t length = 0;
+    while (length < 32 && raw[offset + length] != 0) {
+        length++;
+    }
+    return std::string(raw.begin() + offset, raw.begin() + offset + length);
+}
+
+}
+
+bool Nsf::is_nsf(std::span<const uint8_t> raw) {
+    return raw.size() >= sizeof(NSF_TAG) && std::memcmp(&raw[0], NSF_TAG, sizeof(NSF_TAG)) == 0;
+}
+
+Nsf Nsf::create(std::span<const uint8_t> raw) {
+    if (raw.size() < NSF_HEADER_SIZE) {
+        throw RomParseError("File too small to be a valid NSF");
+    }
+    if (!is_nsf(raw)) {
+        throw RomParseError("Invalid NSF header");
+    }
+    Nsf nsf;
+    nsf.version = raw[0x05];
+    nsf.total_songs = raw[0x06];
+    nsf.starting_song = raw[0x07];
+    nsf.load_address = raw[0x08] | (raw[0x09] << 8);
+    nsf.init_address = raw[0x0A] | (raw[0x0B] << 8);
+    nsf.play_address = raw[0x0C] | (raw[0x0D] << 8);
+    nsf.title = header_string(raw, 0x0E);
+    nsf.artist = header_string(raw, 0x2E);
+    nsf.copyright = header_string(raw, 0x4E);
+    nsf.play_speed_ntsc = raw[0x6E] | (raw[0x6F] << 8);
+    std::memcpy(nsf.bankswitch_init, &raw[0x70], 8);
+    nsf.region = raw[0x7A];
+    nsf.extra_chips = raw[0x7B];
+    nsf.data.assign(raw.begin() + NSF_HEADER_SIZE, raw.end());
+
+    if (nsf.total_songs == 0) {
+        throw RomParseError("NSF has no songs");
+    }
+    if (nsf.starting_song == 0 || nsf.starting_song > nsf.total_songs) {
+        nsf.starting_song = 1;
+    }
+    if (nsf.play_speed_ntsc == 0) {
+        nsf.play_speed_ntsc = 16639;
+    }
+    if (nsf.load_address < 0x8000) {
+        throw RomParseError("NSF load address is outside cartridge space");
+    }
+    if (nsf.data.empty()) {
+        throw RomParseError("NSF has no data");
+    }
+    if (!nsf.uses_bankswitching() && nsf.data.size() > 0x10000u - nsf.load_address) {
+        throw RomParseError("NSF data does not fit below $FFFF");
+    }
+    return nsf;
+}
+
+bool Nsf::uses_bankswitching() const {
+    for (uint8_t bank : bankswitch_init) {
+        if (bank != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Rom Nsf::to_rom() const {
+    size_t offset = uses_bankswitching() ? (load_address & 0xFFF) : (load_address - 0x8000);
+    // Mappers take PRG in whole 8 KB banks; pages past the data read as zero.
+    size_t size = std::max<size_t>(2 * PRG_ROM_PAGE_SIZE, offset + data.size());
+    size = (size + 0x1FFF) & ~static_cast<size_t>(0x1FFF);
+    std::vector<uint8_t> prg(size, 0);
+    std::copy(data.begin(), data.end(), prg.begin() + offset);
+    std::shared_ptr<const RomImage> image = RomImage::from_bytes(std::move(prg));
+    return Rom(image, image->span(), {}, NSF_MAPPER, Mirroring::Horizontal);
+}
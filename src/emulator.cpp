@@ -0,0 +1,184 @@
+#include "emulator.h"
+#include "hash.h"
+#include "rom_index.h"
+#include <stdexcept>
+
+Emulator::Emulator()
+    : cpu(nullptr)
+    , image(nullptr)
+    , save_path()
+    , renderer()
+    , audio()
+    , sample_rate(44100.0)
+    , rate_ratio(1.0)
+    , frames(0)
+    , rom_crc32(0)
+    , render_enabled(true)
+    , run_ahead(0)
+    , run_ahead_state()
+    , rom_index(nullptr)
+{}
+
+void Emulator::load_rom(const std::vector<uint8_t>& bytes, const std::string& save_path) {
+    load_rom(RomImage::from_bytes(bytes), save_path);
+}
+
+void Emulator::load_rom(std::shared_ptr<const RomImage> rom_image, const std::string& rom_save_path) {
+    Rom rom = Rom::create(rom_image);
+    if (rom_index) {
+        rom_index->apply_fix(rom);
+    }
+    rom_crc32 = crc32(rom.chr_rom, crc32(rom.prg_rom));
+    cpu = std::make_unique<CPU>(Bus(std::move(rom), nullptr));
+    Mapper& mapper = *cpu->bus.mapper;
+    if (mapper.battery && mapper.prg_ram.size() > 0 && !rom_save_path.empty()) {
+        mapper.prg_ram.attach_file(rom_save_path);
+    }
+    image = std::move(rom_image);
+    save_path = rom_save_path;
+    cpu->bus.apu.set_sample_rate(sample_rate * rate_ratio);
+    frames = 0;
+    run_ahead_state.clear();
+    cpu->reset();
+}
+
+void Emulator::set_input(size_t port, uint8_t mask) {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    if (port == 0) {
+        cpu->bus.joypad.set_buttons(mask);
+    } else if (port == 1) {
+        cpu->bus.joypad2.set_buttons(mask);
+    } else {
+        throw std::out_of_range("Joypad port must be 0 or 1");
+    }
+}
+
+// Runs the CPU until the PPU enters vblank, then renders the finished
+// picture before the game's NMI handler gets a chance to touch VRAM.
+// Run-ahead frames are thrown away again, so only committed frames may
+// schedule a flush of the battery save.
+void Emulator::emulate_frame(bool render, bool commit) {
+    Bus& bus = cpu->bus;
+    bus.frame_complete = false;
+    while (!bus.frame_complete) {
+        cpu->step();
+    }
+    if (render) {
+        renderer.render(bus.ppu);
+    }
+    if (commit) {
+        bus.mapper->prg_ram.frame_end();
+    }
+}
+
+void Emulator::run_frame() {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    APU& apu = cpu->bus.apu;
+    emulate_frame(render_enabled && run_ahead == 0, true);
+    audio.resize(apu.samples_avail());
+    apu.read_samples(audio.data(), audio.size());
+    frames++;
+    if (run_ahead == 0) {
+        return;
+    }
+    if (run_ahead_state.empty()) {
+        run_ahead_state.resize(state_size());
+    }
+    save_state(run_ahead_state);
+    apu.set_output_muted(true);
+    for (unsigned i = 1; i <= run_ahead; i++) {
+        emulate_frame(render_enabled && i == run_ahead, false);
+    }
+    load_state(run_ahead_state);
+    apu.set_output_muted(false);
+}
+
+void Emulator::redraw() {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    renderer.render(cpu->bus.ppu);
+}
+
+void Emulator::set_audio_muted(bool muted) {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    cpu->bus.apu.set_output_muted(muted);
+}
+
+void Emulator::set_sample_rate(double rate) {
+    sample_rate = rate;
+    if (cpu) {
+        cpu->bus.apu.set_sample_rate(rate * rate_ratio);
+    }
+}
+
+void Emulator::set_rate_ratio(double ratio) {
+    rate_ratio = ratio;
+    if (cpu) {
+        cpu->bus.apu.adjust_sample_rate(sample_rate * ratio);
+    }
+}
+
+void Emulator::reset() {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    cpu->reset();
+}
+
+void Emulator::power_cycle() {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    // The old machine goes first so it has released the save file.
+    uint64_t frames_run = frames;
+    cpu.reset();
+    load_rom(image, save_path);
+    frames = frames_run;
+}
+
+void Emulator::write_state(StateWriter& out) const {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    out.begin_chunk("EMU ", 1);
+    out.write(rom_crc32);
+    out.write(frames);
+    out.end_chunk();
+    cpu->save_state(out);
+}
+
+size_t Emulator::state_size() const {
+    StateWriter counter;
+    write_state(counter);
+    return counter.size();
+}
+
+size_t Emulator::save_state(std::span<uint8_t> buffer) const {
+    StateWriter out(buffer);
+    write_state(out);
+    return out.size();
+}
+
+void Emulator::load_state(std::span<const uint8_t> state) {
+    if (!cpu) {
+        throw std::logic_error("No ROM loaded");
+    }
+    StateReader in(state);
+    if (in.open_chunk("EMU ") != 1) {
+        throw StateError("Unsupported save state version");
+    }
+    if (in.read<uint32_t>() != rom_crc32) {
+        throw StateError("Save state is for a different ROM");
+    }
+    uint64_t saved_frames = in.read<uint64_t>();
+    in.close_chunk();
+    cpu->load_state(in);
+    frames = saved_frames;
+}
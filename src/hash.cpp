@@ -0,0 +1,164 @@
+#include "hash.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Slice-by-8: table[k][b] is the CRC of byte b followed by k zero bytes,
+// so eight input bytes are folded in with eight independent lookups.
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables() {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+            table[0][b] = crc;
+        }
+        for (uint32_t b = 0; b < 256; b++) {
+            for (int k = 1; k < 8; k++) {
+                table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32Tables crc_tables;
+
+uint32_t load_le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint32_t rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+}
+
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc) {
+    const auto& t = crc_tables.table;
+    const uint8_t* p = data.data();
+    size_t n = data.size();
+    crc = ~crc;
+    while (n >= 8) {
+        uint32_t lo = load_le32(p) ^ crc;
+        uint32_t hi = load_le32(p + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+Sha1::Sha1()
+    : state{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0}
+    , block{}
+    , block_used(0)
+    , total_bytes(0)
+{}
+
+void Sha1::process(const uint8_t* chunk) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (chunk[i * 4] << 24) | (chunk[i * 4 + 1] << 16)
+             | (chunk[i * 4 + 2] << 8) | chunk[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void Sha1::update(std::span<const uint8_t> data) {
+    const uint8_t* p = data.data();
+    size_t n = data.size();
+    total_bytes += n;
+    if (block_used > 0) {
+        size_t take = std::min(n, sizeof(block) - block_used);
+        std::memcpy(block + block_used, p, take);
+        block_used += take;
+        p += take;
+        n -= take;
+        if (block_used < sizeof(block)) {
+            return;
+        }
+        process(block);
+        block_used = 0;
+    }
+    while (n >= sizeof(block)) {
+        process(p);
+        p += sizeof(block);
+        n -= sizeof(block);
+    }
+    std::memcpy(block, p, n);
+    block_used = n;
+}
+
+Sha1Digest Sha1::finish() {
+    uint64_t bits = total_bytes * 8;
+    uint8_t padding[72] = {0x80};
+    size_t pad = (block_used < 56 ? 56 : 120) - block_used;
+    update({padding, pad});
+    uint8_t length[8];
+    for (int i = 0; i < 8; i++) {
+        length[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    update({length, 8});
+    Sha1Digest digest;
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 4; j++) {
+            digest[i * 4 + j] = static_cast<uint8_t>(state[i] >> (24 - j * 8));
+        }
+    }
+    return digest;
+}
+
+Sha1Digest sha1(std::span<const uint8_t> data) {
+    Sha1 hasher;
+    hasher.update(data);
+    return hasher.finish();
+}
+
+std::string to_hex(const Sha1Digest& digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text;
+    text.reserve(digest.size() * 2);
+    for (uint8_t byte : digest) {
+        text += digits[byte >> 4];
+        text += digits[byte & 0xF];
+    }
+    return text;
+}
@@ -0,0 +1,453 @@
+#include "emulator.h"
+#include "hash.h"
+#include "movie.h"
+#include "movie_keyframes.h"
+#include "nsf_player.h"
+#include "render/filter_pipeline.h"
+#include "audio/wav_writer.h"
+#include "rom_index.h"
+#include "rewind_buffer.h"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: nes-emu-headless ROM [options]\n"
+              << "  --frames N         frames to emulate (default 60)\n"
+              << "  --dump-frames DIR  write every frame to DIR as PPM\n"
+              << "  --filter NAME      upscale dumped frames (scale2x, hq4x, xbr4x, ntsc, ...)\n"
+              << "  --input FILE       joypad input, one line per frame (see below)\n"
+              << "  --movie FILE       play a movie (or FCEUX .fm2) from power-on\n"
+              << "  --record FILE      record the frames' input to a movie\n"
+              << "  --seek N           start the movie after its first N frames\n"
+              << "  --keyframes FILE   seek index for the movie, built if missing or stale\n"
+              << "  --keyframe-interval N  frames between keyframes (default 600)\n"
+              << "  --hash             print the SHA-1 of the final machine state\n"
+              << "  --wav FILE         write the audio output to FILE\n"
+              << "  --wav-format FMT   s16 (default) or f32\n"
+              << "  --sample-rate HZ   audio sample rate (default 44100)\n"
+              << "  --save FILE        keep battery-backed PRG-RAM in FILE\n"
+              << "  --index FILE       correct bad headers from a nes-rom-index file\n"
+              << "  --load-state FILE  start from a save state\n"
+              << "  --save-state FILE  write a save state after the last frame\n"
+              << "  --track N          NSF track to play, 1-based (default: the file's)\n"
+              << "  --run-ahead N      show each frame N frames early (see the SDL frontend)\n"
+              << "  --rewind           record per-frame rewind history (for benchmarking)\n"
+              << "  --benchmark        report emulation speed\n"
+              << "\n"
+              << "Input files hold one line per frame with a hex button mask for\n"
+              << "pad 1 and optionally pad 2 (A=01 B=02 Select=04 Start=08 Up=10\n"
+              << "Down=20 Left=40 Right=80). Text after '#' is ignored; frames past\n"
+              << "the end of the file have no buttons pressed.\n"
+              << "\n"
+              << "With --movie, --frames defaults to the movie's length and the\n"
+              << "final state hash is always printed.\n"
+              << "\n"
+              << "NSF files are played without the PPU; --frames then counts PLAY\n"
+              << "calls.\n";
+}
+
+std::vector<uint8_t> read_binary(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+}
+
+void write_binary(const std::string& filename, const uint8_t* data, size_t size) {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(data), size)) {
+        throw std::runtime_error("Could not write file: " + filename);
+    }
+}
+
+// Times repeated save/load round trips of the current state.
+void benchmark_states(Emulator& emulator) {
+    const int rounds = 10000;
+    std::vector<uint8_t> state(emulator.state_size());
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        emulator.save_state(state);
+    }
+    auto saved = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        emulator.load_state(state);
+    }
+    auto loaded = std::chrono::steady_clock::now();
+    double save_us = std::chrono::duration<double, std::micro>(saved - start).count() / rounds;
+    double load_us = std::chrono::duration<double, std::micro>(loaded - saved).count() / rounds;
+    std::cout << "save state: " << state.size() << " bytes, " << save_us << " us save, "
+              << load_us << " us load\n";
+}
+
+std::vector<std::array<uint8_t, 2>> read_input_script(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    std::vector<std::array<uint8_t, 2>> frames;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        std::array<uint8_t, 2> pads = {0, 0};
+        std::string field;
+        size_t port = 0;
+        while (fields >> field) {
+            if (port == 2) {
+                throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": too many fields");
+            }
+            size_t used = 0;
+            unsigned long mask = 0;
+            try {
+                mask = std::stoul(field, &used, 16);
+            } catch (const std::exception&) {
+            }
+            if (used != field.size() || mask > 0xFF) {
+                throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": bad button mask '" + field + "'");
+            }
+            pads[port++] = static_cast<uint8_t>(mask);
+        }
+        if (port > 0) {
+            frames.push_back(pads);
+        }
+    }
+    return frames;
+}
+
+void write_ppm(const std::filesystem::path& path, const uint8_t* rgb, size_t width, size_t height) {
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n" << width << " " << height << "\n255\n";
+    out.write(reinterpret_cast<const char*>(rgb), width * height * 3);
+}
+
+void write_ppm(const std::filesystem::path& path, const uint32_t* xrgb, size_t width, size_t height) {
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t i = 0; i < width * height; i++) {
+        rgb[i * 3] = (xrgb[i] >> 16) & 0xFF;
+        rgb[i * 3 + 1] = (xrgb[i] >> 8) & 0xFF;
+        rgb[i * 3 + 2] = xrgb[i] & 0xFF;
+    }
+    write_ppm(path, rgb.data(), width, height);
+}
+
+void play_nsf(std::span<const uint8_t> bytes, int track, uint64_t periods,
+              uint32_t sample_rate, WavWriter* wav, bool benchmark) {
+    NsfPlayer player(Nsf::create(bytes));
+    const Nsf& nsf = player.info();
+    std::cout << "NSF: " << nsf.title << " - " << nsf.artist << " ("
+              << static_cast<int>(nsf.total_songs) << " tracks)\n";
+    player.set_sample_rate(sample_rate);
+    if (track > 0) {
+        player.start_track(static_cast<uint8_t>(track - 1));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t period = 0; period < periods; period++) {
+        player.run_period();
+        if (wav) {
+            const std::vector<float>& samples = player.audio_samples();
+            wav->write(samples.data(), samples.size());
+        }
+    }
+    if (wav) {
+        wav->close();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (benchmark) {
+        double played = player.cycles() / APU::CPU_CLOCK_RATE;
+        std::cout << periods << " PLAY calls (" << played << " s of music) in " << seconds
+                  << " s: " << played / seconds << "x realtime\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string rom_path;
+    std::string dump_dir;
+    std::string filter_name;
+    std::string input_path;
+    std::string wav_path;
+    std::string save_path;
+    std::string index_path;
+    std::string load_state_path;
+    std::string save_state_path;
+    std::string movie_path;
+    std::string record_path;
+    std::string keyframes_path;
+    WavFormat wav_format = WavFormat::Pcm16;
+    uint32_t sample_rate = 44100;
+    uint64_t frame_limit = 60;
+    bool frames_given = false;
+    uint64_t seek_frame = 0;
+    uint32_t keyframe_interval = 600;
+    bool print_hash = false;
+    int track = 0;
+    bool benchmark = false;
+    bool record_rewind = false;
+    unsigned run_ahead = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            frame_limit = std::stoull(argv[++i]);
+            frames_given = true;
+        } else if (arg == "--dump-frames" && i + 1 < argc) {
+            dump_dir = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter_name = argv[++i];
+        } else if (arg == "--input" && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (arg == "--movie" && i + 1 < argc) {
+            movie_path = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--seek" && i + 1 < argc) {
+            seek_frame = std::stoull(argv[++i]);
+        } else if (arg == "--keyframes" && i + 1 < argc) {
+            keyframes_path = argv[++i];
+        } else if (arg == "--keyframe-interval" && i + 1 < argc) {
+            keyframe_interval = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--hash") {
+            print_hash = true;
+        } else if (arg == "--wav" && i + 1 < argc) {
+            wav_path = argv[++i];
+        } else if (arg == "--wav-format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "s16") {
+                wav_format = WavFormat::Pcm16;
+            } else if (name == "f32") {
+                wav_format = WavFormat::Float32;
+            } else {
+                std::cerr << "Unknown WAV format: " << name << "\n";
+                return 1;
+            }
+        } else if (arg == "--sample-rate" && i + 1 < argc) {
+            sample_rate = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--save" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (arg == "--index" && i + 1 < argc) {
+            index_path = argv[++i];
+        } else if (arg == "--load-state" && i + 1 < argc) {
+            load_state_path = argv[++i];
+        } else if (arg == "--save-state" && i + 1 < argc) {
+            save_state_path = argv[++i];
+        } else if (arg == "--track" && i + 1 < argc) {
+            track = std::stoi(argv[++i]);
+        } else if (arg == "--run-ahead" && i + 1 < argc) {
+            run_ahead = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--rewind") {
+            record_rewind = true;
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-' && rom_path.empty()) {
+            rom_path = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (rom_path.empty()) {
+        print_usage();
+        return 1;
+    }
+    if (!movie_path.empty() && (!input_path.empty() || !load_state_path.empty())) {
+        std::cerr << "--movie plays from power-on and cannot be combined with --input or --load-state\n";
+        return 1;
+    }
+    if (movie_path.empty() && (seek_frame > 0 || !keyframes_path.empty())) {
+        std::cerr << "--seek and --keyframes need --movie\n";
+        return 1;
+    }
+
+    try {
+        std::shared_ptr<const RomImage> image = RomImage::map_file(rom_path);
+        if (Nsf::is_nsf(image->span())) {
+            std::unique_ptr<WavWriter> wav;
+            if (!wav_path.empty()) {
+                wav = std::make_unique<WavWriter>(wav_path, sample_rate, wav_format);
+            }
+            play_nsf(image->span(), track, frame_limit, sample_rate, wav.get(), benchmark);
+            return 0;
+        }
+
+        Emulator emulator;
+        emulator.set_sample_rate(sample_rate);
+        if (!index_path.empty()) {
+            emulator.set_rom_index(std::make_shared<const RomIndex>(RomIndex::load(index_path)));
+        }
+        emulator.load_rom(image, save_path);
+        if (!load_state_path.empty()) {
+            emulator.load_state(read_binary(load_state_path));
+        }
+        emulator.set_run_ahead(run_ahead);
+        // Nothing looks at the picture, so skip drawing it.
+        if (dump_dir.empty()) {
+            emulator.set_render_enabled(false);
+        }
+
+        std::vector<std::array<uint8_t, 2>> input;
+        if (!input_path.empty()) {
+            input = read_input_script(input_path);
+        }
+        Movie movie;
+        if (!movie_path.empty()) {
+            movie = Movie::load(movie_path);
+            if (movie.rom_crc32 != 0 && movie.rom_crc32 != emulator.rom_crc()) {
+                throw std::runtime_error("Movie was recorded on a different ROM");
+            }
+            if (!frames_given) {
+                frame_limit = movie.frames.size();
+            }
+            print_hash = true;
+            if (seek_frame > movie.frames.size() || seek_frame > frame_limit) {
+                throw std::runtime_error("--seek is past the last frame");
+            }
+        }
+        MovieKeyframes keyframes;
+        double seek_seconds = 0.0;
+        if (!keyframes_path.empty()) {
+            if (std::filesystem::exists(keyframes_path)) {
+                keyframes = MovieKeyframes::load(keyframes_path);
+            }
+            if (!keyframes.matches(emulator, movie)) {
+                auto build_start = std::chrono::steady_clock::now();
+                keyframes = MovieKeyframes::build(emulator, movie, keyframe_interval);
+                keyframes.save(keyframes_path);
+                double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+                std::cerr << "Built " << keyframes.size() << " keyframes (" << keyframes.bytes()
+                          << " bytes) in " << build_seconds << " s\n";
+            }
+            auto seek_start = std::chrono::steady_clock::now();
+            keyframes.seek(emulator, movie, seek_frame);
+            seek_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - seek_start).count();
+        } else if (seek_frame > 0) {
+            auto seek_start = std::chrono::steady_clock::now();
+            for (uint64_t frame = 0; frame < seek_frame; frame++) {
+                play_movie_frame(emulator, movie.frames[frame]);
+            }
+            seek_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - seek_start).count();
+        }
+        Movie recording;
+        recording.rom_crc32 = emulator.rom_crc();
+        recording.frames.assign(movie.frames.begin(), movie.frames.begin() + seek_frame);
+        std::unique_ptr<WavWriter> wav;
+        if (!wav_path.empty()) {
+            wav = std::make_unique<WavWriter>(wav_path, sample_rate, wav_format);
+        }
+
+        std::unique_ptr<FilterPipeline> filter_pipeline;
+        if (!filter_name.empty()) {
+            filter_pipeline = std::make_unique<FilterPipeline>(
+                make_filter(filter_name), std::thread::hardware_concurrency());
+        }
+        if (!dump_dir.empty()) {
+            std::filesystem::create_directories(dump_dir);
+        }
+
+        std::unique_ptr<RewindBuffer> rewind;
+        std::vector<uint8_t> rewind_state;
+        double rewind_seconds = 0.0;
+        if (record_rewind) {
+            rewind_state.resize(emulator.state_size());
+            rewind = std::make_unique<RewindBuffer>(rewind_state.size(), 60 * 60, 8 << 20);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t frame = seek_frame + 1; frame <= frame_limit; frame++) {
+            MovieFrame step = {};
+            if (frame <= movie.frames.size()) {
+                step = movie.frames[frame - 1];
+            } else if (frame <= input.size()) {
+                step.pads[0] = input[frame - 1][0];
+                step.pads[1] = input[frame - 1][1];
+            }
+            if (!record_path.empty()) {
+                recording.frames.push_back(step);
+            }
+            play_movie_frame(emulator, step);
+            if (rewind) {
+                auto rewind_start = std::chrono::steady_clock::now();
+                emulator.save_state(rewind_state);
+                rewind->push(rewind_state);
+                rewind_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - rewind_start).count();
+            }
+            if (wav) {
+                const std::vector<float>& samples = emulator.audio_samples();
+                wav->write(samples.data(), samples.size());
+            }
+            if (dump_dir.empty()) {
+                continue;
+            }
+            char name[32];
+            std::snprintf(name, sizeof(name), "frame_%06llu.ppm", static_cast<unsigned long long>(frame));
+            std::filesystem::path path = std::filesystem::path(dump_dir) / name;
+            if (filter_pipeline) {
+                const uint32_t* pixels = filter_pipeline->process(emulator.framebuffer());
+                write_ppm(path, pixels, filter_pipeline->output_width(), filter_pipeline->output_height());
+            } else {
+                write_ppm(path, emulator.framebuffer().get_data(), Frame::WIDTH, Frame::HEIGHT);
+            }
+        }
+        if (wav) {
+            wav->close();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!record_path.empty()) {
+            recording.save(record_path);
+        }
+        if (!save_state_path.empty() || print_hash) {
+            std::vector<uint8_t> state(emulator.state_size());
+            emulator.save_state(state);
+            if (!save_state_path.empty()) {
+                write_binary(save_state_path, state.data(), state.size());
+            }
+            if (print_hash) {
+                std::cout << "state sha1: " << to_hex(sha1(state)) << "\n";
+            }
+        }
+        if (benchmark) {
+            uint64_t frames_run = frame_limit - seek_frame;
+            double fps = frames_run / seconds;
+            std::cout << frames_run << " frames in " << seconds << " s: "
+                      << fps << " fps (" << fps / 60.0988 << "x realtime)\n";
+            if (seek_frame > 0) {
+                std::cout << "seek to frame " << seek_frame << ": " << seek_seconds * 1e3 << " ms\n";
+            }
+            benchmark_states(emulator);
+            if (rewind) {
+                std::cout << "rewind: " << rewind->size() << " states in " << rewind->bytes_used()
+                          << " bytes, " << rewind_seconds * 1e6 / frames_run << " us per frame\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -5,24 +5,25 @@ Joypad::Joypad()
     : strobe(false)
     , button_index(0)
     , button_status(0)
+    , latched(0)
 {}
 
 void Joypad::write(uint8_t data) {
-    strobe = (data & 1) != 0;
-    if (strobe) {
+    if (strobe || (data & 1)) {
+        latched = button_status;
         button_index = 0;
     }
+    strobe = (data & 1) != 0;
 }
 
 uint8_t Joypad::read() {
+    if (strobe) {
+        return button_status & BUTTON_A;
+    }
     if (button_index > 7) {
         return 1;
     }
-    uint8_t response = (button_status & (1 << button_index)) ? 1 : 0;
-    if (!strobe && button_index <= 7) {
-        button_index++;
-    }
-    return response;
+    return (latched >> button_index++) & 1;
 }
 
 void Joypad::set_button_status(JoypadButton button, bool pressed) {
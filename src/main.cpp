@@ -1,15 +1,77 @@
 #include <SDL2/SDL.h>
-#include "cartridge.h"
-#include "render/renderer.h"
-#include "cpu.h"
-#include "bus.h"
+#include "emulator.h"
+#include "render/filter_pipeline.h"
+#include "audio/audio_sync.h"
+#include "rewind_buffer.h"
+#include "movie.h"
+#include "netplay.h"
+#include "udp_link.h"
+#include <filesystem>
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+static void audio_callback(void* userdata, Uint8* stream, int len) {
+    AudioSync* sync = static_cast<AudioSync*>(userdata);
+    sync->pull(reinterpret_cast<float*>(stream), len / sizeof(float));
+}
 
 int main(int argc, char* argv[]) {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    std::unique_ptr<FilterPipeline> filter_pipeline;
+    double latency_ms = 40.0;
+    unsigned run_ahead = 0;
+    std::string record_path;
+    std::string peer;
+    uint16_t netplay_port = 7000;
+    size_t player = 0;
+    unsigned input_delay = 0;
+    bool show_stats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--latency" && i + 1 < argc) {
+            latency_ms = std::stod(argv[++i]);
+        } else if (arg == "--run-ahead" && i + 1 < argc) {
+            run_ahead = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (arg == "--peer" && i + 1 < argc) {
+            peer = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            netplay_port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "--player" && i + 1 < argc) {
+            player = std::stoul(argv[++i]) == 2 ? 1 : 0;
+        } else if (arg == "--delay" && i + 1 < argc) {
+            input_delay = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            try {
+                filter_pipeline = std::make_unique<FilterPipeline>(
+                    make_filter(argv[++i]), std::thread::hardware_concurrency());
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        }
+    }
+    // Rollback re-runs up to 8 frames at once, and each of them would also
+    // pay for the run-ahead frames.
+    if (run_ahead > 0 && !peer.empty()) {
+        std::cerr << "--run-ahead cannot be used with --peer" << std::endl;
+        return 1;
+    }
+    // Netplay frames only become final once the peer's input arrives, which
+    // the loop below never sees, so a recording would come out empty.
+    if (!record_path.empty() && !peer.empty()) {
+        std::cerr << "--record cannot be used with --peer" << std::endl;
+        return 1;
+    }
+    int output_width = filter_pipeline ? filter_pipeline->output_width() : 256;
+    int output_height = filter_pipeline ? filter_pipeline->output_height() : 240;
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
         std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
         return 1;
     }
@@ -17,8 +79,8 @@ int main(int argc, char* argv[]) {
         "NES Emulator",
         SDL_WINDOWPOS_CENTERED,
         SDL_WINDOWPOS_CENTERED,
-        256 * 3,  
-        240 * 3,
+        filter_pipeline ? output_width : 256 * 3,
+        filter_pipeline ? output_width * 240 / 256 : 240 * 3,
         SDL_WINDOW_SHOWN
     );
     if (!window) {
@@ -26,20 +88,19 @@ int main(int argc, char* argv[]) {
         SDL_Quit();
         return 1;
     }
-    SDL_Renderer* sdl_renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    SDL_Renderer* sdl_renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (!sdl_renderer) {
         std::cerr << "Renderer creation failed: " << SDL_GetError() << std::endl;
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
-    SDL_RenderSetScale(sdl_renderer, 3.0f, 3.0f);
     SDL_Texture* texture = SDL_CreateTexture(
         sdl_renderer,
-        SDL_PIXELFORMAT_RGB24, 
+        filter_pipeline ? SDL_PIXELFORMAT_RGB888 : SDL_PIXELFORMAT_RGB24,
         SDL_TEXTUREACCESS_STREAMING,  
-        256,  
-        240   
+        output_width,
+        output_height
     );
     if (!texture) {
         std::cerr << "Texture creation failed: " << SDL_GetError() << std::endl;
@@ -48,23 +109,89 @@ int main(int argc, char* argv[]) {
         SDL_Quit();
         return 1;
     }
-    std::ifstream file("test/roms/flappybird.nes", std::ios::binary);
-    if (!file) {
-        std::cerr << "Failed to open flappybird.nes" << std::endl;
+    std::filesystem::path rom_path = "test/roms/flappybird.nes";
+    std::shared_ptr<const RomImage> rom_image;
+    try {
+        rom_image = RomImage::map_file(rom_path.string());
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to open flappybird.nes: " << e.what() << std::endl;
         SDL_DestroyTexture(texture);
         SDL_DestroyRenderer(sdl_renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
-    std::vector<uint8_t> rom_data((std::istreambuf_iterator<char>(file)),
-                                std::istreambuf_iterator<char>());
-    file.close();
-    Rom cartridge = Rom::create(rom_data);
-    std::cout << "Loaded ROM - PRG: " << cartridge.prg_rom.size() << " bytes, CHR:" << cartridge.chr_rom.size() << " bytes" << std::endl;
-    Renderer nes_renderer;
+    Emulator emulator;
+    // Recordings and netplay have to start from power-on, so they leave
+    // the battery save alone.
+    std::string save_path;
+    if (record_path.empty() && peer.empty()) {
+        save_path = std::filesystem::path(rom_path).replace_extension(".sav").string();
+    }
+    emulator.load_rom(rom_image, save_path);
+    Movie recording;
+    recording.rom_crc32 = emulator.rom_crc();
+    emulator.set_run_ahead(run_ahead);
+    std::unique_ptr<UdpLink> netplay_link;
+    std::unique_ptr<RollbackSession> netplay;
+    if (!peer.empty()) {
+        try {
+            netplay_link = std::make_unique<UdpLink>(netplay_port);
+            netplay_link->connect(peer);
+            netplay = std::make_unique<RollbackSession>(emulator, *netplay_link, player, input_delay);
+        } catch (const std::exception& e) {
+            std::cerr << "Netplay: " << e.what() << std::endl;
+            SDL_DestroyTexture(texture);
+            SDL_DestroyRenderer(sdl_renderer);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
+    }
+
+    // The device period is kept well under the target latency so the queue,
+    // not the device, decides how far audio runs behind.
+    SDL_AudioSpec wanted{};
+    wanted.freq = 48000;
+    wanted.format = AUDIO_F32SYS;
+    wanted.channels = 1;
+    wanted.samples = 256;
+    wanted.callback = audio_callback;
+    SDL_AudioSpec obtained{};
+    std::unique_ptr<AudioSync> audio_sync;
+    try {
+        audio_sync = std::make_unique<AudioSync>(wanted.freq, latency_ms);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(sdl_renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    wanted.userdata = audio_sync.get();
+    SDL_AudioDeviceID audio_device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+    if (!audio_device) {
+        std::cerr << "Audio device failed: " << SDL_GetError() << std::endl;
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(sdl_renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    emulator.set_sample_rate(obtained.freq);
+    SDL_PauseAudioDevice(audio_device, 0);
+
+    // Holding Backspace steps back through the last minute, one frame per
+    // frame. Rewinding plays silence so the audio queue still paces the loop.
+    std::vector<uint8_t> state(emulator.state_size());
+    RewindBuffer rewind(state.size(), 60 * 60, 8 << 20);
+    std::vector<float> silence(obtained.freq / 60, 0.0f);
+    bool rewinding = false;
+
     SDL_Event event;
-    int frame_count = 0;
+    uint8_t buttons = 0;
+    uint8_t commands = 0;
     std::map<SDL_Keycode, JoypadButton> key_map = {
         {SDLK_DOWN, JoypadButton::DOWN},
         {SDLK_UP, JoypadButton::UP},
@@ -76,52 +203,101 @@ int main(int argc, char* argv[]) {
         {SDLK_s, JoypadButton::BUTTON_B}
     };
 
-    Bus bus(std::move(cartridge), [&](const NesPPU& ppu, Joypad& joypad) {
-        frame_count++;
-        if (frame_count % 60 == 0) {
-            std::cout << "Rendered " << frame_count << " frames..." << std::endl;
-        }
-        nes_renderer.render(ppu);
-        const Frame& frame = nes_renderer.get_frame();
-        SDL_UpdateTexture(texture, nullptr, frame.get_data(), 256 * 3);
-        SDL_RenderClear(sdl_renderer);
-        SDL_RenderCopy(sdl_renderer, texture, nullptr, nullptr);
-        SDL_RenderPresent(sdl_renderer);
-
+    bool running = true;
+    while (running) {
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
-                std::exit(0);
+                running = false;
             }
             if (event.type == SDL_KEYDOWN) {
                 if (event.key.keysym.sym == SDLK_ESCAPE) {
-                    std::exit(0);
+                    running = false;
+                }
+                if (event.key.keysym.sym == SDLK_BACKSPACE) {
+                    rewinding = true;
+                }
+                if (event.key.keysym.sym == SDLK_F5) {
+                    commands |= MOVIE_RESET;
                 }
                 auto it = key_map.find(event.key.keysym.sym);
                 if (it != key_map.end()) {
-                    joypad.set_button_status(it->second, true);
+                    buttons |= it->second;
                 }
             }
             if (event.type == SDL_KEYUP) {
+                if (event.key.keysym.sym == SDLK_BACKSPACE) {
+                    rewinding = false;
+                }
                 auto it = key_map.find(event.key.keysym.sym);
                 if (it != key_map.end()) {
-                    joypad.set_button_status(it->second, false);
+                    buttons &= ~it->second;
                 }
             }
         }
-    });
-    CPU cpu(std::move(bus));
-    cpu.reset();
-    cpu.run();
-    std::cout << "\nCPU stopped. Total frames rendered: " << frame_count << std::endl;
-    bool running = true;
-    while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT || 
-                (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)) {
-                running = false;
+        emulator.set_rate_ratio(audio_sync->update_rate_ratio());
+        if (netplay) {
+            // No rewind in netplay: the peer's machine cannot follow.
+            netplay->poll();
+            if (netplay->should_wait() || !netplay->advance(buttons)) {
+                SDL_Delay(1);
+                continue;
+            }
+            const std::vector<float>& samples = emulator.audio_samples();
+            audio_sync->push(samples.data(), samples.size());
+        } else if (rewinding && rewind.pop(state)) {
+            emulator.load_state(state);
+            emulator.redraw();
+            audio_sync->push(silence.data(), silence.size());
+        } else {
+            MovieFrame step = {{buttons, 0}, commands};
+            commands = 0;
+            if (!record_path.empty()) {
+                // Rewinding takes the recording back with the machine.
+                recording.frames.resize(emulator.frame_count());
+                recording.frames.push_back(step);
             }
+            // The state is saved before the frame runs, so the first pop
+            // goes back one frame rather than reloading the one on screen.
+            emulator.save_state(state);
+            rewind.push(state);
+            play_movie_frame(emulator, step);
+            const std::vector<float>& samples = emulator.audio_samples();
+            audio_sync->push(samples.data(), samples.size());
+        }
+
+        const Frame& frame = emulator.framebuffer();
+        if (filter_pipeline) {
+            const uint32_t* pixels = filter_pipeline->process(frame);
+            SDL_UpdateTexture(texture, nullptr, pixels, output_width * 4);
+        } else {
+            SDL_UpdateTexture(texture, nullptr, frame.get_data(), 256 * 3);
+        }
+        SDL_RenderClear(sdl_renderer);
+        SDL_RenderCopy(sdl_renderer, texture, nullptr, nullptr);
+        SDL_RenderPresent(sdl_renderer);
+
+        if (show_stats && emulator.frame_count() % 300 == 0) {
+            AudioMetrics m = audio_sync->metrics();
+            std::cout << "Audio: fill " << m.fill << "/" << m.target
+                      << ", underruns " << m.underruns << ", dropped " << m.dropped
+                      << ", ratio " << m.rate_ratio << std::endl;
+        }
+        // Audio paces emulation: wait for the device to drain the queue
+        // back below its target before producing another frame.
+        while (running && audio_sync->is_full()) {
+            SDL_Delay(1);
+        }
+    }
+    SDL_CloseAudioDevice(audio_device);
+    if (netplay && netplay->desynced()) {
+        std::cerr << "Netplay: machines diverged at frame " << netplay->desync_frame() << std::endl;
+    }
+    if (!record_path.empty()) {
+        try {
+            recording.save(record_path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
         }
-        SDL_Delay(16); 
     }
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(sdl_renderer);
@@ -0,0 +1,38 @@
+#include "mappers/discrete.h"
+
+// The base constructor already maps the first 16 KB at $8000 and the last
+// at $C000, which mirrors a 16 KB NROM image and is UxROM's power-on state.
+NromMapper::NromMapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+{}
+
+void NromMapper::write_register(uint16_t, uint8_t) {
+}
+
+UxromMapper::UxromMapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+{}
+
+void UxromMapper::write_register(uint16_t, uint8_t data) {
+    set_prg_16k(0, data);
+}
+
+CnromMapper::CnromMapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+{}
+
+void CnromMapper::write_register(uint16_t, uint8_t data) {
+    set_chr_8k(data);
+}
+
+AxromMapper::AxromMapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+{
+    set_prg_32k(0);
+    mirroring = Mirroring::SingleScreenLower;
+}
+
+void AxromMapper::write_register(uint16_t, uint8_t data) {
+    set_prg_32k(data & 0x07);
+    mirroring = (data & 0x10) ? Mirroring::SingleScreenUpper : Mirroring::SingleScreenLower;
+}
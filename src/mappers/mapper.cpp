@@ -0,0 +1,184 @@
+#include "mappers/mapper.h"
+#include "mappers/discrete.h"
+#include "mappers/mmc1.h"
+#include "mappers/mmc3.h"
+#include "mappers/nsf.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+Mapper::Mapper(Rom rom, std::span<uint8_t> chr_ram_memory)
+    : prg_banks{}
+    , chr_banks{}
+    , mirroring(rom.screen_mirroring)
+    , uses_a12_clock(false)
+    , irq(false)
+    , prg_ram(rom.prg_ram_size + rom.prg_nvram_size)
+    , prg_ram_enabled(true)
+    , prg_ram_writable(true)
+    , battery(rom.battery)
+    , image(std::move(rom.image))
+    , prg(rom.prg_rom)
+    , chr(rom.chr_rom)
+    , chr_ram(chr_ram_memory)
+    , chr_is_ram(chr.empty())
+{
+    if (prg.empty() || prg.size() % PRG_BANK_SIZE != 0) {
+        throw RomParseError("PRG ROM size is not a multiple of 8 KB");
+    }
+    if (chr_ram.size() != chr_ram_size(rom)) {
+        throw std::logic_error("CHR-RAM does not match the cartridge");
+    }
+    if (chr_is_ram) {
+        chr = chr_ram;
+    } else if (chr.size() % CHR_BANK_SIZE != 0) {
+        throw RomParseError("CHR ROM size is not a multiple of 1 KB");
+    }
+    set_prg_32k(0);
+    set_prg_16k(1, -1);
+    set_chr_8k(0);
+}
+
+size_t Mapper::chr_ram_size(const Rom& rom) {
+    if (!rom.chr_rom.empty()) {
+        return 0;
+    }
+    // A header that declares neither CHR ROM nor CHR RAM is broken; give it
+    // the 8 KB every such board has.
+    size_t size = rom.chr_ram_size + rom.chr_nvram_size;
+    return size ? size : CHR_ROM_PAGE_SIZE;
+}
+
+void Mapper::set_prg_4k(size_t slot, int bank) {
+    int count = static_cast<int>(prg.size() / PRG_PAGE_SIZE);
+    bank %= count;
+    if (bank < 0) {
+        bank += count;
+    }
+    prg_banks[slot] = &prg[bank * PRG_PAGE_SIZE];
+}
+
+void Mapper::set_prg_8k(size_t slot, int bank) {
+    int count = static_cast<int>(prg.size() / PRG_BANK_SIZE);
+    bank %= count;
+    if (bank < 0) {
+        bank += count;
+    }
+    set_prg_4k(slot * 2, bank * 2);
+    set_prg_4k(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::set_prg_16k(size_t slot, int bank) {
+    if (bank < 0) {
+        bank += static_cast<int>(prg.size() / (2 * PRG_BANK_SIZE));
+        if (bank < 0) {
+            bank = 0;
+        }
+    }
+    set_prg_8k(slot * 2, bank * 2);
+    set_prg_8k(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::set_prg_32k(int bank) {
+    set_prg_16k(0, bank * 2);
+    set_prg_16k(1, bank * 2 + 1);
+}
+
+void Mapper::set_chr_1k(size_t slot, int bank) {
+    int count = static_cast<int>(chr.size() / CHR_BANK_SIZE);
+    bank %= count;
+    if (bank < 0) {
+        bank += count;
+    }
+    chr_banks[slot] = &chr[bank * CHR_BANK_SIZE];
+}
+
+void Mapper::set_chr_4k(size_t slot, int bank) {
+    for (size_t i = 0; i < 4; i++) {
+        set_chr_1k(slot * 4 + i, bank * 4 + static_cast<int>(i));
+    }
+}
+
+void Mapper::set_chr_8k(int bank) {
+    set_chr_4k(0, bank * 2);
+    set_chr_4k(1, bank * 2 + 1);
+}
+
+void Mapper::save_state(StateWriter& out) const {
+    out.begin_chunk("MAPR", 3);
+    out.write(static_cast<uint32_t>(prg.size()));
+    out.write(static_cast<uint32_t>(chr.size()));
+    out.write(static_cast<uint32_t>(prg_ram.size()));
+    for (const uint8_t* bank : prg_banks) {
+        out.write(static_cast<uint32_t>(bank - prg.data()));
+    }
+    for (const uint8_t* bank : chr_banks) {
+        out.write(static_cast<uint32_t>(bank - chr.data()));
+    }
+    out.write(mirroring);
+    out.write(irq);
+    out.write(prg_ram_enabled);
+    out.write(prg_ram_writable);
+    out.write_bytes(prg_ram.data(), prg_ram.size());
+    save_registers(out);
+    out.end_chunk();
+}
+
+void Mapper::load_state(StateReader& in) {
+    if (in.open_chunk("MAPR") != 3) {
+        throw StateError("Unsupported mapper state version");
+    }
+    if (in.read<uint32_t>() != prg.size() || in.read<uint32_t>() != chr.size()
+        || in.read<uint32_t>() != prg_ram.size()) {
+        throw StateError("Save state is for a different cartridge");
+    }
+    std::array<uint32_t, 8> prg_offsets;
+    std::array<uint32_t, 8> chr_offsets;
+    in.read(prg_offsets);
+    in.read(chr_offsets);
+    for (uint32_t offset : prg_offsets) {
+        if (offset % PRG_PAGE_SIZE != 0 || offset >= prg.size()) {
+            throw StateError("Save state has an invalid PRG bank");
+        }
+    }
+    for (uint32_t offset : chr_offsets) {
+        if (offset % CHR_BANK_SIZE != 0 || offset >= chr.size()) {
+            throw StateError("Save state has an invalid CHR bank");
+        }
+    }
+    for (size_t i = 0; i < prg_banks.size(); i++) {
+        prg_banks[i] = prg.data() + prg_offsets[i];
+    }
+    for (size_t i = 0; i < chr_banks.size(); i++) {
+        chr_banks[i] = chr.data() + chr_offsets[i];
+    }
+    in.read(mirroring);
+    if (static_cast<size_t>(mirroring) > static_cast<size_t>(Mirroring::SingleScreenUpper)) {
+        throw StateError("Save state has an invalid mirroring");
+    }
+    in.read(irq);
+    in.read(prg_ram_enabled);
+    in.read(prg_ram_writable);
+    // Only a real change should wake the save file's flusher; run-ahead
+    // loads a state every frame.
+    std::span<const uint8_t> saved_ram = in.read_view(prg_ram.size());
+    if (!saved_ram.empty() && std::memcmp(saved_ram.data(), prg_ram.data(), saved_ram.size()) != 0) {
+        std::memcpy(prg_ram.data(), saved_ram.data(), saved_ram.size());
+        prg_ram.mark_dirty();
+    }
+    load_registers(in);
+    in.close_chunk();
+}
+
+std::unique_ptr<Mapper> make_mapper(Rom rom, std::span<uint8_t> chr_ram) {
+    switch (rom.mapper) {
+        case 0: return std::make_unique<NromMapper>(std::move(rom), chr_ram);
+        case 1: return std::make_unique<Mmc1Mapper>(std::move(rom), chr_ram);
+        case 2: return std::make_unique<UxromMapper>(std::move(rom), chr_ram);
+        case 3: return std::make_unique<CnromMapper>(std::move(rom), chr_ram);
+        case 4: return std::make_unique<Mmc3Mapper>(std::move(rom), chr_ram);
+        case 7: return std::make_unique<AxromMapper>(std::move(rom), chr_ram);
+        case NSF_MAPPER: return std::make_unique<NsfMapper>(std::move(rom), chr_ram);
+    }
+    throw RomParseError("Unsupported mapper: " + std::to_string(rom.mapper));
+}
@@ -0,0 +1,92 @@
+#include "mappers/mmc1.h"
+
+Mmc1Mapper::Mmc1Mapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+    , shift(0)
+    , shift_count(0)
+    , control(0x0C)
+    , chr_bank0(0)
+    , chr_bank1(0)
+    , prg_bank(0)
+{
+    update_banks();
+}
+
+void Mmc1Mapper::save_registers(StateWriter& out) const {
+    out.write(shift);
+    out.write(shift_count);
+    out.write(control);
+    out.write(chr_bank0);
+    out.write(chr_bank1);
+    out.write(prg_bank);
+}
+
+void Mmc1Mapper::load_registers(StateReader& in) {
+    in.read(shift);
+    in.read(shift_count);
+    in.read(control);
+    in.read(chr_bank0);
+    in.read(chr_bank1);
+    in.read(prg_bank);
+}
+
+void Mmc1Mapper::write_register(uint16_t addr, uint8_t data) {
+    if (data & 0x80) {
+        shift = 0;
+        shift_count = 0;
+        control |= 0x0C;
+        update_banks();
+        return;
+    }
+    shift |= (data & 1) << shift_count;
+    if (++shift_count < 5) {
+        return;
+    }
+    switch ((addr >> 13) & 3) {
+        case 0: control = shift; break;
+        case 1: chr_bank0 = shift; break;
+        case 2: chr_bank1 = shift; break;
+        case 3:
+            prg_bank = shift & 0x0F;
+            prg_ram_enabled = (shift & 0x10) == 0;
+            break;
+    }
+    shift = 0;
+    shift_count = 0;
+    update_banks();
+}
+
+void Mmc1Mapper::update_banks() {
+    static const Mirroring modes[4] = {
+        Mirroring::SingleScreenLower,
+        Mirroring::SingleScreenUpper,
+        Mirroring::Vertical,
+        Mirroring::Horizontal
+    };
+    mirroring = modes[control & 3];
+
+    // 512 KB boards (SUROM) use CHR bank bit 4 to pick the 256 KB half.
+    int outer = prg.size() > 0x40000 ? (chr_bank0 & 0x10) : 0;
+    switch ((control >> 2) & 3) {
+        case 0:
+        case 1:
+            set_prg_16k(0, outer | (prg_bank & 0x0E));
+            set_prg_16k(1, outer | (prg_bank & 0x0E) | 1);
+            break;
+        case 2:
+            set_prg_16k(0, outer);
+            set_prg_16k(1, outer | prg_bank);
+            break;
+        case 3:
+            set_prg_16k(0, outer | prg_bank);
+            set_prg_16k(1, outer | 0x0F);
+            break;
+    }
+
+    if (control & 0x10) {
+        set_chr_4k(0, chr_bank0);
+        set_chr_4k(1, chr_bank1);
+    } else {
+        set_chr_8k(chr_bank0 >> 1);
+    }
+}
@@ -0,0 +1,106 @@
+#include "mappers/mmc3.h"
+
+Mmc3Mapper::Mmc3Mapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+    , bank_select(0)
+    , registers{0, 2, 4, 5, 6, 7, 0, 1}
+    , four_screen(mirroring == Mirroring::FourScreen)
+    , irq_latch(0)
+    , irq_counter(0)
+    , irq_reload(false)
+    , irq_enabled(false)
+{
+    uses_a12_clock = true;
+    update_banks();
+}
+
+void Mmc3Mapper::save_registers(StateWriter& out) const {
+    out.write(bank_select);
+    out.write(registers);
+    out.write(irq_latch);
+    out.write(irq_counter);
+    out.write(irq_reload);
+    out.write(irq_enabled);
+}
+
+void Mmc3Mapper::load_registers(StateReader& in) {
+    in.read(bank_select);
+    in.read(registers);
+    in.read(irq_latch);
+    in.read(irq_counter);
+    in.read(irq_reload);
+    in.read(irq_enabled);
+}
+
+// Registers are decoded by address range and whether the address is even.
+void Mmc3Mapper::write_register(uint16_t addr, uint8_t data) {
+    bool odd = addr & 1;
+    switch (addr & 0xE000) {
+        case 0x8000:
+            if (odd) {
+                registers[bank_select & 7] = data;
+            } else {
+                bank_select = data;
+            }
+            update_banks();
+            break;
+        case 0xA000:
+            if (!odd && !four_screen) {
+                mirroring = (data & 1) ? Mirroring::Horizontal : Mirroring::Vertical;
+            } else if (odd) {
+                prg_ram_enabled = (data & 0x80) != 0;
+                prg_ram_writable = (data & 0x40) == 0;
+            }
+            break;
+        case 0xC000:
+            if (odd) {
+                irq_counter = 0;
+                irq_reload = true;
+            } else {
+                irq_latch = data;
+            }
+            break;
+        case 0xE000:
+            irq_enabled = odd;
+            if (!odd) {
+                irq = false;
+            }
+            break;
+    }
+}
+
+void Mmc3Mapper::clock_a12() {
+    if (irq_counter == 0 || irq_reload) {
+        irq_counter = irq_latch;
+        irq_reload = false;
+    } else {
+        irq_counter--;
+    }
+    if (irq_counter == 0 && irq_enabled) {
+        irq = true;
+    }
+}
+
+void Mmc3Mapper::update_banks() {
+    // Bit 7 swaps the 2 KB and 1 KB CHR halves; bit 6 swaps which of
+    // $8000 and $C000 is fixed to the second-to-last bank.
+    size_t chr_2k = (bank_select & 0x80) ? 4 : 0;
+    size_t chr_1k = (bank_select & 0x80) ? 0 : 4;
+    set_chr_1k(chr_2k + 0, registers[0] & 0xFE);
+    set_chr_1k(chr_2k + 1, registers[0] | 1);
+    set_chr_1k(chr_2k + 2, registers[1] & 0xFE);
+    set_chr_1k(chr_2k + 3, registers[1] | 1);
+    for (size_t i = 0; i < 4; i++) {
+        set_chr_1k(chr_1k + i, registers[2 + i]);
+    }
+
+    if (bank_select & 0x40) {
+        set_prg_8k(0, -2);
+        set_prg_8k(2, registers[6] & 0x3F);
+    } else {
+        set_prg_8k(0, registers[6] & 0x3F);
+        set_prg_8k(2, -2);
+    }
+    set_prg_8k(1, registers[7] & 0x3F);
+    set_prg_8k(3, -1);
+}
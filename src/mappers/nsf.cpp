@@ -0,0 +1,18 @@
+#include "mappers/nsf.h"
+
+NsfMapper::NsfMapper(Rom rom, std::span<uint8_t> chr_ram)
+    : Mapper(std::move(rom), chr_ram)
+{
+    for (size_t slot = 0; slot < prg_banks.size(); slot++) {
+        set_prg_4k(slot, static_cast<int>(slot));
+    }
+}
+
+void NsfMapper::write_register(uint16_t, uint8_t) {
+}
+
+void NsfMapper::write_expansion(uint16_t addr, uint8_t data) {
+    if (addr >= 0x5FF8) {
+        set_prg_4k(addr - 0x5FF8, data);
+    }
+}
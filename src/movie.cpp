@@ -0,0 +1,243 @@
+#include "movie.h"
+#include "emulator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const char MOVIE_MAGIC[8] = {'N', 'E', 'S', 'M', 'O', 'V', 0, 0};
+const uint32_t MOVIE_VERSION = 1;
+const uint8_t KNOWN_COMMANDS = MOVIE_RESET | MOVIE_POWER;
+// A run holds any number of frames, so a few damaged bytes can claim
+// billions of them. Longer movies than this are refused.
+const uint32_t MAX_MOVIE_FRAMES = 100 * 60 * 60 * 60;
+// Run length varint plus the frame.
+const size_t MIN_RUN_SIZE = 4;
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& data) : bytes(data), pos(0) {}
+    uint8_t get_u8() {
+        need(1);
+        return bytes[pos++];
+    }
+    uint32_t get_u32() {
+        need(4);
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; i++) {
+            value |= static_cast<uint32_t>(bytes[pos + i]) << (i * 8);
+        }
+        pos += 4;
+        return value;
+    }
+    uint64_t get_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = get_u8();
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Movie has a bad run length");
+    }
+    size_t remaining() const { return bytes.size() - pos; }
+private:
+    const std::vector<uint8_t>& bytes;
+    size_t pos;
+    void need(size_t size) const {
+        if (size > remaining()) {
+            throw std::runtime_error("Movie is truncated");
+        }
+    }
+};
+
+// FM2 gamepad fields list the buttons as "RLDUTSBA", the same order as
+// the JoypadButton bits from high to low. Anything but '.' or a space
+// means the button is held.
+uint8_t parse_fm2_pad(const std::string& field, size_t line_number) {
+    if (field.empty()) {
+        return 0;
+    }
+    if (field.size() != 8) {
+        throw std::runtime_error("FM2 line " + std::to_string(line_number) + ": bad gamepad field");
+    }
+    uint8_t mask = 0;
+    for (size_t i = 0; i < 8; i++) {
+        if (field[i] != '.' && field[i] != ' ') {
+            mask |= 0x80 >> i;
+        }
+    }
+    return mask;
+}
+
+}
+
+Movie::Movie()
+    : rom_crc32(0)
+    , frames()
+{}
+
+Movie Movie::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open movie: " + path);
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(MOVIE_MAGIC) || std::memcmp(data.data(), MOVIE_MAGIC, sizeof(MOVIE_MAGIC)) != 0) {
+        return parse_fm2(std::string(data.begin(), data.end()));
+    }
+    Reader in(data);
+    for (size_t i = 0; i < sizeof(MOVIE_MAGIC); i++) {
+        in.get_u8();
+    }
+    if (in.get_u32() != MOVIE_VERSION) {
+        throw std::runtime_error("Unsupported movie version: " + path);
+    }
+    Movie movie;
+    movie.rom_crc32 = in.get_u32();
+    uint32_t frame_count = in.get_u32();
+    if (frame_count > MAX_MOVIE_FRAMES) {
+        throw std::runtime_error("Movie is too long: " + path);
+    }
+    // Every run is checked before any frames are allocated, so a damaged
+    // file fails on its length rather than on memory.
+    std::vector<std::pair<uint32_t, MovieFrame>> runs;
+    runs.reserve(std::min<size_t>(frame_count, in.remaining() / MIN_RUN_SIZE));
+    uint32_t total = 0;
+    while (total < frame_count) {
+        uint64_t length = in.get_varint();
+        MovieFrame frame;
+        frame.pads[0] = in.get_u8();
+        frame.pads[1] = in.get_u8();
+        frame.commands = in.get_u8();
+        if (length == 0 || length > frame_count - total) {
+            throw std::runtime_error("Movie has a bad run length: " + path);
+        }
+        runs.emplace_back(static_cast<uint32_t>(length), frame);
+        total += static_cast<uint32_t>(length);
+    }
+    if (in.remaining() != 0) {
+        throw std::runtime_error("Movie has trailing data: " + path);
+    }
+    movie.frames.reserve(frame_count);
+    for (const auto& [length, frame] : runs) {
+        movie.frames.insert(movie.frames.end(), length, frame);
+    }
+    return movie;
+}
+
+Movie Movie::parse_fm2(const std::string& text) {
+    Movie movie;
+    std::istringstream lines(text);
+    std::string line;
+    size_t line_number = 0;
+    bool has_version = false;
+    while (std::getline(lines, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] != '|') {
+            std::string key = line.substr(0, line.find(' '));
+            std::string value = key.size() < line.size() ? line.substr(key.size() + 1) : "";
+            if (key == "version") {
+                has_version = true;
+            } else if (key == "binary" && value != "0") {
+                throw std::runtime_error("Binary FM2 movies are not supported");
+            } else if (key == "savestate") {
+                throw std::runtime_error("FM2 movies that start from a savestate are not supported");
+            } else if ((key == "port0" || key == "port1") && value != "0" && value != "1") {
+                throw std::runtime_error("FM2 " + key + " is not a gamepad");
+            } else if (key == "port2" && value != "0") {
+                throw std::runtime_error("FM2 expansion port devices are not supported");
+            }
+            continue;
+        }
+        if (!has_version) {
+            throw std::runtime_error("Not an FM2 movie");
+        }
+        // |commands|port0|port1|port2|
+        std::vector<std::string> fields;
+        size_t start = 1;
+        size_t bar;
+        while ((bar = line.find('|', start)) != std::string::npos) {
+            fields.push_back(line.substr(start, bar - start));
+            start = bar + 1;
+        }
+        if (fields.size() < 3) {
+            throw std::runtime_error("FM2 line " + std::to_string(line_number) + ": too few fields");
+        }
+        MovieFrame frame;
+        frame.commands = static_cast<uint8_t>(std::strtoul(fields[0].c_str(), nullptr, 10)) & KNOWN_COMMANDS;
+        frame.pads[0] = parse_fm2_pad(fields[1], line_number);
+        frame.pads[1] = parse_fm2_pad(fields[2], line_number);
+        if (movie.frames.size() >= MAX_MOVIE_FRAMES) {
+            throw std::runtime_error("Movie is too long");
+        }
+        movie.frames.push_back(frame);
+    }
+    if (!has_version) {
+        throw std::runtime_error("Not an FM2 movie");
+    }
+    return movie;
+}
+
+void Movie::save(const std::string& path) const {
+    if (frames.size() > MAX_MOVIE_FRAMES) {
+        throw std::length_error("Movie is too long to save");
+    }
+    std::vector<uint8_t> out(MOVIE_MAGIC, MOVIE_MAGIC + sizeof(MOVIE_MAGIC));
+    put_u32(out, MOVIE_VERSION);
+    put_u32(out, rom_crc32);
+    put_u32(out, static_cast<uint32_t>(frames.size()));
+    for (size_t i = 0; i < frames.size();) {
+        size_t run = 1;
+        while (i + run < frames.size() && frames[i + run] == frames[i]) {
+            run++;
+        }
+        put_varint(out, run);
+        out.push_back(frames[i].pads[0]);
+        out.push_back(frames[i].pads[1]);
+        out.push_back(frames[i].commands);
+        i += run;
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(out.data()), out.size())) {
+        throw std::runtime_error("Could not write movie: " + path);
+    }
+}
+
+void play_movie_frame(Emulator& emu, const MovieFrame& frame) {
+    if (frame.commands & MOVIE_POWER) {
+        emu.power_cycle();
+    } else if (frame.commands & MOVIE_RESET) {
+        emu.reset();
+    }
+    emu.set_input(0, frame.pads[0]);
+    emu.set_input(1, frame.pads[1]);
+    emu.run_frame();
+}
@@ -0,0 +1,155 @@
+#include "movie_keyframes.h"
+#include "emulator.h"
+#include "hash.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const char KEYFRAMES_MAGIC[8] = {'N', 'E', 'S', 'K', 'E', 'Y', 'S', 0};
+const uint32_t KEYFRAMES_VERSION = 1;
+const size_t KEYFRAMES_HEADER_SIZE = 40;
+
+uint32_t frames_crc32(const Movie& movie) {
+    static_assert(sizeof(MovieFrame) == 3, "movie frames are hashed bytewise");
+    return crc32({reinterpret_cast<const uint8_t*>(movie.frames.data()),
+                  movie.frames.size() * sizeof(MovieFrame)});
+}
+
+void put_u32(std::vector<uint8_t>& out, uint64_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+}
+
+MovieKeyframes::MovieKeyframes()
+    : rom_crc32(0)
+    , movie_crc32(0)
+    , movie_frames(0)
+    , interval(1)
+    , state_size(0)
+    , count(0)
+    , file(nullptr)
+    , states()
+{}
+
+MovieKeyframes MovieKeyframes::build(Emulator& emu, const Movie& movie, uint32_t interval) {
+    if (interval == 0) {
+        throw std::invalid_argument("Keyframe interval must be at least 1");
+    }
+    if (movie.frames.size() > UINT32_MAX) {
+        throw std::length_error("Movie is too long to index");
+    }
+    MovieKeyframes keys;
+    keys.rom_crc32 = emu.rom_crc();
+    keys.movie_crc32 = frames_crc32(movie);
+    keys.movie_frames = static_cast<uint32_t>(movie.frames.size());
+    keys.interval = interval;
+    keys.state_size = emu.state_size();
+    keys.count = movie.frames.size() / interval + 1;
+
+    std::vector<uint8_t> bytes(keys.count * keys.state_size);
+    uint8_t* next = bytes.data();
+    for (size_t frame = 0;; frame++) {
+        if (frame % interval == 0) {
+            emu.save_state({next, keys.state_size});
+            next += keys.state_size;
+        }
+        if (frame == movie.frames.size()) {
+            break;
+        }
+        play_movie_frame(emu, movie.frames[frame]);
+    }
+    keys.file = RomImage::from_bytes(std::move(bytes));
+    keys.states = keys.file->span();
+    return keys;
+}
+
+MovieKeyframes MovieKeyframes::load(const std::string& path) {
+    std::shared_ptr<const RomImage> file = RomImage::map_file(path);
+    const uint8_t* header = file->data();
+    if (file->size() < KEYFRAMES_HEADER_SIZE || std::memcmp(header, KEYFRAMES_MAGIC, sizeof(KEYFRAMES_MAGIC)) != 0) {
+        throw std::runtime_error("Not a keyframe index: " + path);
+    }
+    if (get_u32(header + 8) != KEYFRAMES_VERSION) {
+        throw std::runtime_error("Unsupported keyframe index version: " + path);
+    }
+    MovieKeyframes keys;
+    keys.rom_crc32 = get_u32(header + 12);
+    keys.movie_crc32 = get_u32(header + 16);
+    keys.movie_frames = get_u32(header + 20);
+    keys.interval = get_u32(header + 24);
+    keys.state_size = get_u32(header + 28);
+    keys.count = get_u32(header + 32);
+    if (keys.interval == 0 || keys.count != keys.movie_frames / keys.interval + 1
+        || file->size() - KEYFRAMES_HEADER_SIZE != static_cast<uint64_t>(keys.count) * keys.state_size) {
+        throw std::runtime_error("Keyframe index has the wrong size: " + path);
+    }
+    keys.states = file->span().subspan(KEYFRAMES_HEADER_SIZE);
+    keys.file = std::move(file);
+    return keys;
+}
+
+void MovieKeyframes::save(const std::string& path) const {
+    std::vector<uint8_t> header(KEYFRAMES_MAGIC, KEYFRAMES_MAGIC + sizeof(KEYFRAMES_MAGIC));
+    put_u32(header, KEYFRAMES_VERSION);
+    put_u32(header, rom_crc32);
+    put_u32(header, movie_crc32);
+    put_u32(header, movie_frames);
+    put_u32(header, interval);
+    put_u32(header, state_size);
+    put_u32(header, count);
+    put_u32(header, 0);
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(header.data()), header.size());
+        if (!out.write(reinterpret_cast<const char*>(states.data()), states.size())) {
+            throw std::runtime_error("Could not write keyframe index: " + temp_path);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        throw std::runtime_error("Could not replace keyframe index: " + path);
+    }
+}
+
+bool MovieKeyframes::matches(const Emulator& emu, const Movie& movie) const {
+    return count > 0
+        && rom_crc32 == emu.rom_crc()
+        && state_size == emu.state_size()
+        && movie_frames == movie.frames.size()
+        && movie_crc32 == frames_crc32(movie);
+}
+
+void MovieKeyframes::seek(Emulator& emu, const Movie& movie, uint64_t frame) const {
+    if (movie.frames.size() != movie_frames) {
+        throw std::logic_error("Keyframes are for another movie");
+    }
+    if (frame > movie_frames) {
+        throw std::out_of_range("Seek past the end of the movie");
+    }
+    uint64_t key = frame / interval;
+    emu.load_state(states.subspan(key * state_size, state_size));
+    // Only the frame sought to is drawn.
+    bool render = emu.is_render_enabled();
+    emu.set_render_enabled(false);
+    for (uint64_t i = key * interval; i < frame; i++) {
+        play_movie_frame(emu, movie.frames[i]);
+    }
+    emu.set_render_enabled(render);
+    if (render) {
+        emu.redraw();
+    }
+}
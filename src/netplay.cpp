@@ -0,0 +1,241 @@
+#include "netplay.h"
+#include "emulator.h"
+#include "hash.h"
+#include "udp_link.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Packet layout, little-endian:
+//   0  'N' 'P' version reserved
+//   4  u32 sender's frame
+//   8  u32 how many of the receiver's inputs the sender has
+//  12  i16 sender's frame advantage, u16 input count
+//  16  u32 frame of the first input
+//  20  u32 hashed frame (0: none), u32 its state CRC-32
+//  28  inputs
+const uint8_t PACKET_VERSION = 1;
+const size_t PACKET_HEADER_SIZE = 28;
+const size_t MAX_PACKET_INPUTS = 255;
+const uint64_t NO_ROLLBACK = std::numeric_limits<uint64_t>::max();
+const auto RESEND_INTERVAL = std::chrono::milliseconds(8);
+
+void put(uint8_t* p, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        p[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+uint32_t get(const uint8_t* p, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= static_cast<uint32_t>(p[i]) << (i * 8);
+    }
+    return value;
+}
+
+}
+
+RollbackSession::RollbackSession(Emulator& emulator, UdpLink& udp, size_t player, unsigned input_delay)
+    : emu(emulator)
+    , link(udp)
+    , local_player(player)
+    , current_frame(0)
+    , local_inputs(input_delay, 0)
+    , remote_inputs()
+    , remote_used()
+    , rollback_from(NO_ROLLBACK)
+    , states()
+    , peer_ack(0)
+    , peer_advantage(0)
+    , hashed_frame(0)
+    , checked_frame(0)
+    , local_hashes()
+    , remote_hashes()
+    , desync(false)
+    , desync_at(0)
+    , statistics()
+    , last_send()
+{
+    if (player > 1) {
+        throw std::out_of_range("Netplay player must be 0 or 1");
+    }
+    if (!emu.is_loaded()) {
+        throw std::logic_error("No ROM loaded");
+    }
+    for (auto& state : states) {
+        state.resize(emu.state_size());
+    }
+}
+
+uint64_t RollbackSession::confirmed_frame() const {
+    return std::min<uint64_t>(remote_inputs.size(), current_frame);
+}
+
+// Unknown inputs are predicted to be the last known one: players mostly
+// hold buttons for many frames.
+uint8_t RollbackSession::remote_input(uint64_t frame) const {
+    if (frame < remote_inputs.size()) {
+        return remote_inputs[frame];
+    }
+    return remote_inputs.empty() ? 0 : remote_inputs.back();
+}
+
+void RollbackSession::run(uint64_t frame) {
+    emu.save_state(states[frame % states.size()]);
+    uint8_t remote = remote_input(frame);
+    if (frame == remote_used.size()) {
+        remote_used.push_back(remote);
+    } else {
+        remote_used[frame] = remote;
+    }
+    emu.set_input(local_player, local_inputs[frame]);
+    emu.set_input(1 - local_player, remote);
+    emu.run_frame();
+}
+
+void RollbackSession::poll() {
+    uint8_t packet[PACKET_HEADER_SIZE + MAX_PACKET_INPUTS];
+    size_t size;
+    while ((size = link.receive(packet)) > 0) {
+        receive_packet(packet, size);
+    }
+    roll_back();
+    hash_confirmed();
+    // advance() sends every frame; this keeps acknowledgements flowing
+    // while a side is stalled or waiting.
+    if (std::chrono::steady_clock::now() - last_send >= RESEND_INTERVAL) {
+        send_packet();
+    }
+}
+
+bool RollbackSession::advance(uint8_t local_input) {
+    if (current_frame >= remote_inputs.size() + MAX_ROLLBACK) {
+        statistics.stalls++;
+        return false;
+    }
+    roll_back();
+    local_inputs.push_back(local_input);
+    run(current_frame);
+    current_frame++;
+    hash_confirmed();
+    send_packet();
+    return true;
+}
+
+bool RollbackSession::should_wait() const {
+    int64_t advantage = static_cast<int64_t>(current_frame) - static_cast<int64_t>(remote_inputs.size());
+    return advantage - peer_advantage >= 2;
+}
+
+void RollbackSession::receive_packet(const uint8_t* data, size_t size) {
+    if (size < PACKET_HEADER_SIZE || data[0] != 'N' || data[1] != 'P' || data[2] != PACKET_VERSION) {
+        return;
+    }
+    peer_ack = std::max<uint64_t>(peer_ack, get(data + 8, 4));
+    peer_advantage = static_cast<int16_t>(get(data + 12, 2));
+    size_t count = std::min<size_t>(get(data + 14, 2), size - PACKET_HEADER_SIZE);
+    uint64_t first = get(data + 16, 4);
+    // Inputs are taken strictly in order; a packet starting past the
+    // last known input is ignored and its inputs come again later.
+    for (size_t i = 0; i < count && first + i <= remote_inputs.size(); i++) {
+        uint64_t frame = first + i;
+        if (frame < remote_inputs.size()) {
+            continue;
+        }
+        uint8_t input = data[PACKET_HEADER_SIZE + i];
+        remote_inputs.push_back(input);
+        if (frame < current_frame && remote_used[frame] != input) {
+            rollback_from = std::min(rollback_from, frame);
+        }
+    }
+    uint64_t hash_frame = get(data + 20, 4);
+    if (hash_frame > checked_frame) {
+        remote_hashes[hash_frame % HASH_HISTORY] = {hash_frame, get(data + 24, 4), true};
+        compare_hashes(hash_frame);
+    }
+}
+
+void RollbackSession::roll_back() {
+    if (rollback_from >= current_frame) {
+        rollback_from = NO_ROLLBACK;
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t frames = current_frame - rollback_from;
+    bool render = emu.is_render_enabled();
+    emu.set_render_enabled(false);
+    emu.set_audio_muted(true);
+    emu.load_state(states[rollback_from % states.size()]);
+    for (uint64_t frame = rollback_from; frame < current_frame; frame++) {
+        run(frame);
+    }
+    emu.set_audio_muted(false);
+    emu.set_render_enabled(render);
+    if (render) {
+        emu.redraw();
+    }
+    rollback_from = NO_ROLLBACK;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    statistics.rollbacks++;
+    statistics.frames_resimulated += frames;
+    statistics.max_rollback_frames = std::max<uint32_t>(statistics.max_rollback_frames, frames);
+    statistics.max_rollback_ms = std::max(statistics.max_rollback_ms, ms);
+}
+
+// The state before frame f is final once the inputs of every earlier
+// frame are known and any rollback has been applied.
+void RollbackSession::hash_confirmed() {
+    if (current_frame == 0) {
+        return;
+    }
+    uint64_t last = std::min<uint64_t>(remote_inputs.size(), current_frame - 1);
+    for (uint64_t frame = hashed_frame + 1; frame <= last; frame++) {
+        uint32_t crc = crc32(states[frame % states.size()]);
+        local_hashes[frame % HASH_HISTORY] = {frame, crc, true};
+        compare_hashes(frame);
+    }
+    hashed_frame = std::max(hashed_frame, last);
+}
+
+void RollbackSession::compare_hashes(uint64_t frame) {
+    HashSlot& local = local_hashes[frame % HASH_HISTORY];
+    HashSlot& remote = remote_hashes[frame % HASH_HISTORY];
+    if (!local.valid || !remote.valid || local.frame != frame || remote.frame != frame) {
+        return;
+    }
+    checked_frame = std::max(checked_frame, frame);
+    statistics.hashes_checked++;
+    if (local.crc != remote.crc && !desync) {
+        desync = true;
+        desync_at = frame;
+    }
+    remote.valid = false;
+}
+
+void RollbackSession::send_packet() {
+    uint8_t packet[PACKET_HEADER_SIZE + MAX_PACKET_INPUTS];
+    uint64_t first = std::min<uint64_t>(peer_ack, local_inputs.size());
+    size_t count = std::min<size_t>(local_inputs.size() - first, MAX_PACKET_INPUTS);
+    int64_t advantage = static_cast<int64_t>(current_frame) - static_cast<int64_t>(remote_inputs.size());
+    packet[0] = 'N';
+    packet[1] = 'P';
+    packet[2] = PACKET_VERSION;
+    packet[3] = 0;
+    put(packet + 4, current_frame, 4);
+    put(packet + 8, remote_inputs.size(), 4);
+    put(packet + 12, static_cast<uint16_t>(std::clamp<int64_t>(advantage, INT16_MIN, INT16_MAX)), 2);
+    put(packet + 14, count, 2);
+    put(packet + 16, first, 4);
+    const HashSlot& hash = local_hashes[hashed_frame % HASH_HISTORY];
+    bool has_hash = hashed_frame > 0 && hash.valid && hash.frame == hashed_frame;
+    put(packet + 20, has_hash ? hashed_frame : 0, 4);
+    put(packet + 24, has_hash ? hash.crc : 0, 4);
+    std::copy_n(local_inputs.begin() + first, count, packet + PACKET_HEADER_SIZE);
+    link.send({packet, PACKET_HEADER_SIZE + count});
+    last_send = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,267 @@
+#include "emulator.h"
+#include "hash.h"
+#include "movie.h"
+#include "netplay.h"
+#include "udp_link.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: nes-emu-netplay ROM [options]\n"
+              << "  --player N       1 or 2 (default 1)\n"
+              << "  --port N         local UDP port (default 7000)\n"
+              << "  --peer HOST:PORT the other player\n"
+              << "  --movie FILE     take this player's input from a movie\n"
+              << "  --frames N       frames to play (default: the movie's length, or 600)\n"
+              << "  --fps N          frame rate, 0 for as fast as possible (default 60)\n"
+              << "  --delay N        input delay in frames (default 0)\n"
+              << "  --latency MS     delay our outgoing packets\n"
+              << "  --jitter MS      add up to this much random delay\n"
+              << "  --loss P         drop this fraction of outgoing packets\n"
+              << "  --seed N         seed for the simulated network\n"
+              << "  --loopback       run both players here over 127.0.0.1 and check\n"
+              << "                   the result against a plain run of the movie\n"
+              << "\n"
+              << "Player 1 drives joypad 1 and player 2 joypad 2; each side reads its\n"
+              << "own pad from the movie and ignores its resets. When both sides are\n"
+              << "done, the SHA-1 of the final state is printed; the two must match.\n";
+}
+
+struct PeerOptions {
+    size_t player;
+    unsigned input_delay;
+    uint64_t frames;
+    double fps;
+    double latency_ms;
+    double jitter_ms;
+    double loss;
+    uint32_t seed;
+};
+
+struct PeerResult {
+    NetplayStats stats;
+    uint64_t packets_sent;
+    uint64_t packets_dropped;
+    bool desynced;
+    uint64_t desync_frame;
+    std::string state_sha1;
+};
+
+std::string state_sha1(const Emulator& emulator) {
+    std::vector<uint8_t> state(emulator.state_size());
+    emulator.save_state(state);
+    return to_hex(sha1(state));
+}
+
+// Plays until every frame is confirmed on this side and the peer has all
+// of our inputs, then keeps answering until `stop` is set so our last
+// acknowledgements get through.
+PeerResult run_peer(Emulator& emulator, UdpLink& link, const Movie& movie, const PeerOptions& options,
+                    std::atomic<bool>& done, const std::atomic<bool>& stop) {
+    RollbackSession session(emulator, link, options.player, options.input_delay);
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.fps > 0 ? 1.0 / options.fps : 0.0));
+    auto next = std::chrono::steady_clock::now();
+    while (!stop) {
+        session.poll();
+        uint64_t frame = session.frame();
+        bool advanced = false;
+        if (frame < options.frames && std::chrono::steady_clock::now() >= next) {
+            if (session.should_wait()) {
+                next += period;
+            } else {
+                uint8_t input = frame < movie.frames.size() ? movie.frames[frame].pads[options.player] : 0;
+                advanced = session.advance(input);
+                if (advanced) {
+                    next += period;
+                }
+            }
+        }
+        if (session.confirmed_frame() >= options.frames && session.peer_acked() >= options.frames) {
+            done = true;
+        }
+        if (!advanced) {
+            std::this_thread::sleep_for(std::chrono::microseconds(options.fps > 0 ? 500 : 50));
+        }
+    }
+    PeerResult result;
+    result.stats = session.stats();
+    result.packets_sent = link.packets_sent();
+    result.packets_dropped = link.packets_dropped();
+    result.desynced = session.desynced();
+    result.desync_frame = session.desync_frame();
+    result.state_sha1 = state_sha1(emulator);
+    return result;
+}
+
+void print_result(size_t player, uint64_t frames, const PeerResult& result) {
+    const NetplayStats& s = result.stats;
+    std::printf("player %zu: %llu frames, %llu rollbacks (%llu frames re-run, longest %u frames in %.2f ms), "
+                "%llu stalls, %llu hashes checked, %llu packets sent, %llu dropped\n",
+                player + 1, static_cast<unsigned long long>(frames),
+                static_cast<unsigned long long>(s.rollbacks),
+                static_cast<unsigned long long>(s.frames_resimulated),
+                s.max_rollback_frames, s.max_rollback_ms,
+                static_cast<unsigned long long>(s.stalls),
+                static_cast<unsigned long long>(s.hashes_checked),
+                static_cast<unsigned long long>(result.packets_sent),
+                static_cast<unsigned long long>(result.packets_dropped));
+    if (result.desynced) {
+        std::printf("player %zu: DESYNC at frame %llu\n", player + 1,
+                    static_cast<unsigned long long>(result.desync_frame));
+    }
+    std::printf("player %zu: state sha1 %s\n", player + 1, result.state_sha1.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string rom_path;
+    std::string movie_path;
+    std::string peer;
+    uint16_t port = 7000;
+    bool loopback = false;
+    bool frames_given = false;
+    PeerOptions options = {0, 0, 600, 60.0, 0.0, 0.0, 0.0, 1};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--player" && i + 1 < argc) {
+            options.player = std::stoul(argv[++i]) - 1;
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "--peer" && i + 1 < argc) {
+            peer = argv[++i];
+        } else if (arg == "--movie" && i + 1 < argc) {
+            movie_path = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.frames = std::stoull(argv[++i]);
+            frames_given = true;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            options.fps = std::stod(argv[++i]);
+        } else if (arg == "--delay" && i + 1 < argc) {
+            options.input_delay = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--latency" && i + 1 < argc) {
+            options.latency_ms = std::stod(argv[++i]);
+        } else if (arg == "--jitter" && i + 1 < argc) {
+            options.jitter_ms = std::stod(argv[++i]);
+        } else if (arg == "--loss" && i + 1 < argc) {
+            options.loss = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--loopback") {
+            loopback = true;
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-' && rom_path.empty()) {
+            rom_path = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (rom_path.empty() || (!loopback && peer.empty()) || options.player > 1) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        std::shared_ptr<const RomImage> image = RomImage::map_file(rom_path);
+        Movie movie;
+        if (!movie_path.empty()) {
+            movie = Movie::load(movie_path);
+            if (!frames_given) {
+                options.frames = movie.frames.size();
+            }
+        }
+
+        if (!loopback) {
+            Emulator emulator;
+            emulator.load_rom(image);
+            emulator.set_render_enabled(false);
+            UdpLink link(port);
+            link.connect(peer);
+            link.simulate(options.latency_ms, options.jitter_ms, options.loss, options.seed);
+            std::atomic<bool> done(false);
+            std::atomic<bool> stop(false);
+            // Linger a second after finishing so the peer hears that we
+            // have all of its inputs.
+            std::thread timer([&] {
+                while (!done) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                stop = true;
+            });
+            PeerResult result = run_peer(emulator, link, movie, options, done, stop);
+            timer.join();
+            print_result(options.player, options.frames, result);
+            return result.desynced ? 1 : 0;
+        }
+
+        Emulator emulators[2];
+        std::unique_ptr<UdpLink> links[2];
+        for (size_t player = 0; player < 2; player++) {
+            emulators[player].load_rom(image);
+            emulators[player].set_render_enabled(false);
+            links[player] = std::make_unique<UdpLink>(0);
+        }
+        for (size_t player = 0; player < 2; player++) {
+            links[player]->connect("127.0.0.1", links[1 - player]->local_port());
+            links[player]->simulate(options.latency_ms, options.jitter_ms, options.loss, options.seed + player);
+        }
+        std::atomic<bool> done[2] = {false, false};
+        std::atomic<bool> stop(false);
+        PeerResult results[2];
+        std::vector<std::thread> threads;
+        for (size_t player = 0; player < 2; player++) {
+            threads.emplace_back([&, player] {
+                PeerOptions peer_options = options;
+                peer_options.player = player;
+                results[player] = run_peer(emulators[player], *links[player], movie, peer_options,
+                                           done[player], stop);
+            });
+        }
+        while (!done[0] || !done[1]) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        stop = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        Emulator reference;
+        reference.load_rom(image);
+        reference.set_render_enabled(false);
+        // With input delay, the session plays each input input_delay frames
+        // late and nothing pressed before it.
+        for (uint64_t frame = 0; frame < options.frames; frame++) {
+            MovieFrame step = {};
+            if (frame >= options.input_delay && frame - options.input_delay < movie.frames.size()) {
+                step.pads[0] = movie.frames[frame - options.input_delay].pads[0];
+                step.pads[1] = movie.frames[frame - options.input_delay].pads[1];
+            }
+            play_movie_frame(reference, step);
+        }
+        std::string expected = state_sha1(reference);
+
+        print_result(0, options.frames, results[0]);
+        print_result(1, options.frames, results[1]);
+        std::printf("reference: state sha1 %s\n", expected.c_str());
+        bool ok = !results[0].desynced && !results[1].desynced
+               && results[0].state_sha1 == expected && results[1].state_sha1 == expected;
+        std::printf("%s\n", ok ? "OK" : "FAILED");
+        return ok ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,96 @@
+#include "nsf_player.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Return address pushed before INIT and PLAY. Nothing is mapped at
+// $4020, so a driver never jumps there on its own; reaching it means the
+// routine has returned.
+const uint16_t RETURN_SENTINEL = 0x4020;
+
+}
+
+NsfPlayer::NsfPlayer(Nsf nsf)
+    : nsf(std::move(nsf))
+    , cpu(nullptr)
+    , audio()
+    , sample_rate(44100.0)
+    , period_cycles(0)
+    , next_play(0)
+    , track(0)
+{
+    period_cycles = static_cast<uint64_t>(
+        std::llround(this->nsf.play_speed_ntsc * APU::CPU_CLOCK_RATE / 1000000.0));
+    start_track(this->nsf.starting_song - 1);
+}
+
+void NsfPlayer::set_sample_rate(double rate) {
+    sample_rate = rate;
+    cpu->bus.apu.set_sample_rate(rate);
+}
+
+void NsfPlayer::start_track(uint8_t index) {
+    if (index >= nsf.total_songs) {
+        throw std::out_of_range("NSF track index out of range");
+    }
+    track = index;
+    cpu = std::make_unique<CPU>(Bus(nsf.to_rom(), nullptr));
+    Bus& bus = cpu->bus;
+    bus.ppu_enabled = false;
+    bus.apu.set_sample_rate(sample_rate);
+    for (uint16_t addr = 0x4000; addr <= 0x4013; addr++) {
+        cpu->mem_write(addr, 0);
+    }
+    cpu->mem_write(0x4015, 0x0F);
+    cpu->mem_write(0x4017, 0x40);
+    if (nsf.uses_bankswitching()) {
+        for (uint16_t slot = 0; slot < 8; slot++) {
+            cpu->mem_write(0x5FF8 + slot, nsf.bankswitch_init[slot]);
+        }
+    }
+
+    cpu->register_a = index;
+    cpu->register_x = 0;  // NTSC
+    cpu->register_y = 0;
+    cpu->stack_pointer = STACK_RESET;
+    cpu->status = CpuFlags::from_bits_truncate(0b00100100);
+    call(nsf.init_address);
+    next_play = bus.cycles;
+}
+
+// Pushes the sentinel like a JSR would (RTS adds one to the popped
+// address) and steps until the routine returns to it.
+void NsfPlayer::call(uint16_t address) {
+    uint16_t return_address = RETURN_SENTINEL - 1;
+    cpu->mem_write(STACK + cpu->stack_pointer--, return_address >> 8);
+    cpu->mem_write(STACK + cpu->stack_pointer--, return_address & 0xFF);
+    cpu->program_counter = address;
+    uint64_t limit = cpu->bus.cycles + CALL_CYCLE_LIMIT;
+    while (cpu->program_counter != RETURN_SENTINEL && cpu->bus.cycles < limit) {
+        cpu->step();
+    }
+    if (cpu->program_counter != RETURN_SENTINEL) {
+        // The driver never returned; reset the stack for the next call.
+        cpu->stack_pointer = STACK_RESET;
+    }
+}
+
+void NsfPlayer::run_period() {
+    Bus& bus = cpu->bus;
+    if (bus.cycles < next_play) {
+        bus.cycles = next_play;
+    }
+    call(nsf.play_address);
+    next_play += period_cycles;
+    // Idle until the next PLAY. The driver is not running, so any DMC
+    // fetch stalls have nothing to delay.
+    if (bus.cycles < next_play) {
+        bus.cycles = next_play;
+    }
+    bus.apu.run_until(bus.cycles, bus);
+    bus.apu.take_stall_cycles();
+    bus.apu.end_frame();
+    audio.resize(bus.apu.samples_avail());
+    bus.apu.read_samples(audio.data(), audio.size());
+}
@@ -338,4 +338,16 @@ const std::unordered_map<uint8_t, const OpCode*>& opcodes::get_opcodes_map() {
     }();
     
     return OPCODES_MAP;
-}
\ No newline at end of file
+}
+
+const std::array<const OpCode*, 256>& opcodes::get_opcode_table() {
+    static std::array<const OpCode*, 256> OPCODE_TABLE = []() {
+        std::array<const OpCode*, 256> table{};
+        for (const auto& opcode : get_cpu_opcodes()) {
+            table[opcode.code] = &opcode;
+        }
+        return table;
+    }();
+
+    return OPCODE_TABLE;
+}
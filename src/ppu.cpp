@@ -1,12 +1,13 @@
 #include "ppu.h"
 #include <stdexcept>
-#include <iostream>
 
-NesPPU::NesPPU(std::vector<uint8_t> chr_rom_data, Mirroring mirroring)
-    : chr_rom(chr_rom_data.empty() ? std::vector<uint8_t>(8192, 0) : std::move(chr_rom_data))
-    , vram{}
-    , oam_data{}
-    , palette_table{}
+NesPPU::NesPPU(Mapper* mapper, Mirroring mirroring, std::span<uint8_t, VRAM_SIZE> vram,
+               std::span<uint8_t, OAM_SIZE> oam_data, std::span<uint8_t, PALETTE_SIZE> palette_table)
+    : mapper(mapper)
+    , vram(vram)
+    , nametables{}
+    , oam_data(oam_data)
+    , palette_table(palette_table)
     , mirroring(mirroring)
     , addr()
     , ctrl()
@@ -18,27 +19,70 @@ NesPPU::NesPPU(std::vector<uint8_t> chr_rom_data, Mirroring mirroring)
     , cycles(0)
     , scanline(0)
     , nmi_interrupt(false)
-{}
+    , lines{}
+    , lines_valid(false)
+    , frame_y(0)
+    , frame_y_line(0)
+    , lines_latched(0)
+{
+    set_mirroring(mirroring);
+}
 
-uint16_t NesPPU::mirror_vram_addr(uint16_t addr) const {
-    uint16_t mirrored_vram = addr & 0b10111111111111; 
-    uint16_t vram_index = mirrored_vram - 0x2000;   
-    uint16_t name_table = vram_index / 0x400;     
+// Points the four logical nametables at 1 KB pages of vram.
+// Pages 2 and 3 are the extra cartridge VRAM used only by FourScreen.
+void NesPPU::set_mirroring(Mirroring mirroring) {
+    this->mirroring = mirroring;
+    static const uint8_t pages[5][4] = {
+        {0, 1, 0, 1},  // Vertical
+        {0, 0, 1, 1},  // Horizontal
+        {0, 1, 2, 3},  // FourScreen
+        {0, 0, 0, 0},  // SingleScreenLower
+        {1, 1, 1, 1}   // SingleScreenUpper
+    };
+    const uint8_t* layout = pages[static_cast<size_t>(mirroring)];
+    for (size_t i = 0; i < 4; i++) {
+        nametables[i] = &vram[layout[i] * 0x400];
+    }
+}
 
-    if (mirroring == Mirroring::Vertical) {
-        if (name_table == 2 || name_table == 3) {
-            return vram_index - 0x800;
-        }
-    } else if (mirroring == Mirroring::Horizontal) {
-        if (name_table == 1) {
-            return vram_index - 0x400;
-        } else if (name_table == 2) {
-            return vram_index - 0x400;
-        } else if (name_table == 3) {
-            return vram_index - 0x800;
-        }
+void NesPPU::save_state(StateWriter& out) const {
+    out.begin_chunk("PPU ", 2);
+    out.write(mirroring);
+    out.write(addr);
+    out.write(ctrl);
+    out.write(status);
+    out.write(mask);
+    out.write(scroll);
+    out.write(internal_data_buf);
+    out.write(oam_addr);
+    out.write(cycles);
+    out.write(scanline);
+    out.write(nmi_interrupt);
+    out.end_chunk();
+}
+
+void NesPPU::load_state(StateReader& in) {
+    if (in.open_chunk("PPU ") != 2) {
+        throw StateError("Unsupported PPU state version");
+    }
+    Mirroring saved_mirroring = in.read<Mirroring>();
+    if (static_cast<size_t>(saved_mirroring) > static_cast<size_t>(Mirroring::SingleScreenUpper)) {
+        throw StateError("Save state has an invalid PPU mirroring");
     }
-    return vram_index;
+    in.read(addr);
+    in.read(ctrl);
+    in.read(status);
+    in.read(mask);
+    in.read(scroll);
+    in.read(internal_data_buf);
+    in.read(oam_addr);
+    in.read(cycles);
+    in.read(scanline);
+    in.read(nmi_interrupt);
+    in.close_chunk();
+    set_mirroring(saved_mirroring);
+    lines_valid = false;
+    lines_latched = 0;
 }
 
 void NesPPU::increment_vram_addr() {
@@ -62,16 +106,11 @@ uint8_t NesPPU::read_data() {
 
     if (address >= 0 && address <= 0x1FFF) {
         uint8_t result = internal_data_buf;
-        internal_data_buf = chr_rom[address];
+        internal_data_buf = mapper->read_chr(address);
         return result;
-    } else if (address >= 0x2000 && address <= 0x2FFF) {
+    } else if (address >= 0x2000 && address <= 0x3EFF) {
         uint8_t result = internal_data_buf;
-        internal_data_buf = vram[mirror_vram_addr(address)];
-        return result;
-    } else if (address >= 0x3000 && address <= 0x3EFF) {
-        uint8_t result = internal_data_buf;
-        uint16_t mirrored = address - 0x1000; 
-        internal_data_buf = vram[mirror_vram_addr(mirrored)];
+        internal_data_buf = nametable_at(address);
         return result;
     } else if (address >= 0x3F00 && address <= 0x3FFF) {
         return palette_table[(address - 0x3F00) % 32];
@@ -106,19 +145,30 @@ void NesPPU::write_to_scroll(uint8_t value) {
     scroll.write(value);
 }
 
+// A complete address written while lines are being drawn moves the
+// background on from the next line, which is how games split the screen
+// vertically (the second $2005 write only counts from the next frame).
 void NesPPU::write_to_ppu_addr(uint8_t value) {
     addr.update(value);
+    bool rendering = mask.contains(MaskRegister::SHOW_BACKGROUND) || mask.contains(MaskRegister::SHOW_SPRITES);
+    if (!addr.is_complete() || !rendering || scanline >= 240) {
+        return;
+    }
+    uint16_t address = addr.get();
+    uint16_t coarse_y = (address >> 5) & 0x1F;
+    uint16_t fine_y = (address >> 12) & 0x07;
+    frame_y = ((address & 0x0800) ? 240 : 0) + coarse_y * 8 + fine_y;
+    // Line scanline + 1 is already latched once dot 257 has passed; before
+    // that the PPU still increments y for it.
+    frame_y_line = cycles >= 257 ? scanline + 1 : scanline;
 }
 
 void NesPPU::write_to_data(uint8_t value) {
     uint16_t address = addr.get();
     if (address >= 0 && address <= 0x1FFF) {
-        chr_rom[address] = value;
-    } else if (address >= 0x2000 && address <= 0x2FFF) {
-        vram[mirror_vram_addr(address)] = value;
-    } else if (address >= 0x3000 && address <= 0x3EFF) {
-        uint16_t mirrored = address - 0x1000; 
-        vram[mirror_vram_addr(mirrored)] = value;
+        mapper->write_chr(address, value);
+    } else if (address >= 0x2000 && address <= 0x3EFF) {
+        nametable_at(address) = value;
     } else if (address >= 0x3F00 && address <= 0x3FFF) {
         palette_table[(address - 0x3F00) % 32] = value;
     } else {
@@ -129,18 +179,23 @@ void NesPPU::write_to_data(uint8_t value) {
 
 bool NesPPU::tick(uint8_t cycles) {
     bool vblank_entered = false;
+    uint16_t line_cycle = this->cycles;
     this->cycles += cycles;
+    if (mapper->uses_a12_clock) {
+        clock_mapper_a12(line_cycle, this->cycles);
+    }
+    if (line_cycle < 257 && this->cycles >= 257) {
+        if (scanline == 261) {
+            latch_line(0);
+        } else if (scanline < 239) {
+            latch_line(scanline + 1);
+        }
+    }
     if (this->cycles >= 341) {
         this->cycles -= 341;
         scanline += 1;
 
         if (scanline == 241) {
-            static bool first_vblank = true;
-            if (first_vblank) {
-                std::cout << "PPU: Reached scanline 241 (VBlank), CTRL NMI bit: " 
-                          << (ctrl.contains(ControlRegister::GENERATE_NMI) ? "ON" : "OFF") << std::endl;
-                first_vblank = false;
-            }
             status.set_vblank_status(true);
             if (ctrl.contains(ControlRegister::GENERATE_NMI)) {
                 nmi_interrupt = true;
@@ -169,6 +224,58 @@ bool NesPPU::tick(uint8_t cycles) {
     return vblank_entered;
 }
 
+// Instead of watching every pattern fetch, the PPU works out where in the
+// line A12 first rises. With the usual layout (background at $0000,
+// sprites at $1000) that is the sprite fetch at dot 260; with the tables
+// swapped it is the background prefetch at dot 324. A12 only rises while
+// rendering, on the visible lines and the pre-render line.
+void NesPPU::clock_mapper_a12(uint16_t from, uint16_t to) {
+    if (!mask.contains(MaskRegister::SHOW_BACKGROUND) && !mask.contains(MaskRegister::SHOW_SPRITES)) {
+        return;
+    }
+    if (scanline >= 240 && scanline != 261) {
+        return;
+    }
+    uint16_t rise;
+    if (ctrl.sprite_pattern_addr() == 0x1000 || ctrl.sprite_size() == 16) {
+        rise = 260;
+    } else if (ctrl.background_pattern_addr() == 0x1000) {
+        rise = 324;
+    } else {
+        return;
+    }
+    if (from < rise && to >= rise) {
+        mapper->clock_a12();
+    }
+}
+
+ScanlineLatch NesPPU::current_latch(uint16_t line) const {
+    ScanlineLatch latch;
+    latch.chr_banks = mapper->chr_banks;
+    for (size_t i = 0; i < 4; i++) {
+        latch.nametables[i] = nametables[i];
+    }
+    latch.ctrl = ctrl.bits;
+    latch.x = scroll.get_x() + (ctrl.contains(ControlRegister::NAMETABLE1) ? 256 : 0);
+    latch.y = (scroll.get_y() + (ctrl.contains(ControlRegister::NAMETABLE2) ? 240 : 0) + line) % 480;
+    return latch;
+}
+
+void NesPPU::latch_line(uint16_t line) {
+    if (line == 0) {
+        frame_y = current_latch(0).y;
+        frame_y_line = 0;
+        lines_latched = 0;
+    }
+    ScanlineLatch& latch = lines[line];
+    latch = current_latch(0);
+    latch.y = static_cast<uint16_t>((frame_y + line - frame_y_line + 480u) % 480);
+    lines_latched++;
+    if (lines_latched == lines.size()) {
+        lines_valid = true;
+    }
+}
+
 bool NesPPU::poll_nmi_interrupt() {
     bool result = nmi_interrupt;
     nmi_interrupt = false;
@@ -1,20 +1,20 @@
 #include "ppu/registers/addr.h"
 
 AddrRegister::AddrRegister() 
-    : value(0, 0)
+    : value{0, 0}
     , hi_ptr(true)
 {}
 
 void AddrRegister::set(uint16_t data) {
-    value.first = (data >> 8) & 0xFF;  
-    value.second = data & 0xFF;       
+    value[0] = (data >> 8) & 0xFF;  
+    value[1] = data & 0xFF;       
 }
 
 void AddrRegister::update(uint8_t data) {
     if (hi_ptr) {
-        value.first = data;
+        value[0] = data;
     } else {
-        value.second = data;
+        value[1] = data;
     }
     if (get() > 0x3FFF) {
         set(get() & 0b11111111111111);  
@@ -23,10 +23,10 @@ void AddrRegister::update(uint8_t data) {
 }
 
 void AddrRegister::increment(uint8_t inc) {
-    uint8_t lo = value.second;
-    value.second = value.second + inc;  
-    if (lo > value.second) {
-        value.first = value.first + 1;  
+    uint8_t lo = value[1];
+    value[1] = value[1] + inc;  
+    if (lo > value[1]) {
+        value[0] = value[0] + 1;  
     }
     if (get() > 0x3FFF) {
         set(get() & 0b11111111111111);
@@ -38,5 +38,5 @@ void AddrRegister::reset_latch() {
 }
 
 uint16_t AddrRegister::get() const {
-    return (static_cast<uint16_t>(value.first) << 8) | value.second;
+    return (static_cast<uint16_t>(value[0]) << 8) | value[1];
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "prg_ram.h"
+#include <algorithm>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+PrgRam::PrgRam(size_t size)
+    : memory(size, 0)
+    , bytes(memory.data())
+    , length(size)
+    , dirty(false)
+#if defined(__unix__) || defined(__APPLE__)
+    , fd(-1)
+    , mapping(nullptr)
+#endif
+    , flush_requested(false)
+    , stopping(false)
+{}
+
+PrgRam::~PrgRam() {
+    if (flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        flusher.join();
+    }
+    close_file();
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+void PrgRam::attach_file(const std::string& path) {
+    if (has_file()) {
+        throw std::logic_error("PRG-RAM already has a save file");
+    }
+    if (length == 0) {
+        throw std::logic_error("Cartridge has no PRG-RAM to save");
+    }
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open save file: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 ||
+        (static_cast<size_t>(info.st_size) < length && ::ftruncate(fd, length) != 0)) {
+        close_file();
+        throw std::runtime_error("Could not size save file: " + path);
+    }
+    bool fresh = info.st_size == 0;
+    mapping = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        close_file();
+        throw std::runtime_error("Could not map save file: " + path);
+    }
+    uint8_t* mapped = static_cast<uint8_t*>(mapping);
+    // A new file starts from whatever the game already wrote.
+    if (fresh) {
+        std::copy(memory.begin(), memory.end(), mapped);
+    }
+    bytes = mapped;
+    memory.clear();
+    memory.shrink_to_fit();
+    flusher = std::thread(&PrgRam::flush_loop, this);
+}
+
+void PrgRam::flush_to_disk() {
+    ::msync(mapping, length, MS_SYNC);
+}
+
+void PrgRam::close_file() {
+    if (mapping) {
+        ::msync(mapping, length, MS_SYNC);
+        ::munmap(mapping, length);
+        mapping = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+#else
+
+// Without mmap the flush thread writes a snapshot of the RAM instead.
+void PrgRam::attach_file(const std::string& path) {
+    if (has_file()) {
+        throw std::logic_error("PRG-RAM already has a save file");
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        std::vector<uint8_t> saved((std::istreambuf_iterator<char>(in)),
+                                   std::istreambuf_iterator<char>());
+        std::copy_n(saved.begin(), std::min(saved.size(), length), memory.begin());
+    }
+    save_path = path;
+    flusher = std::thread(&PrgRam::flush_loop, this);
+}
+
+void PrgRam::flush_to_disk() {
+    std::vector<uint8_t> snapshot(bytes, bytes + length);
+    std::ofstream out(save_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size());
+}
+
+void PrgRam::close_file() {
+    if (!save_path.empty()) {
+        flush_to_disk();
+    }
+}
+
+#endif
+
+void PrgRam::frame_end() {
+    if (!dirty || !has_file()) {
+        return;
+    }
+    dirty = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        flush_requested = true;
+    }
+    wake.notify_one();
+}
+
+void PrgRam::flush_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return flush_requested || stopping; });
+        if (stopping) {
+            return;
+        }
+        flush_requested = false;
+        lock.unlock();
+        flush_to_disk();
+        lock.lock();
+    }
+}
@@ -0,0 +1,51 @@
+#include "render/filter_pipeline.h"
+#include <algorithm>
+
+FilterPipeline::FilterPipeline(std::unique_ptr<VideoFilter> filter, size_t threads)
+    : filter(std::move(filter))
+    , pool(std::max<size_t>(threads, 1))
+    , source((Frame::WIDTH + 2 * FilterSource::PADDING) * (Frame::HEIGHT + 2 * FilterSource::PADDING))
+    , width(this->filter->output_width(Frame::WIDTH))
+    , height(this->filter->output_height(Frame::HEIGHT))
+{
+    output.resize(width * height);
+}
+
+void FilterPipeline::prepare_source(const Frame& frame) {
+    const size_t pad = FilterSource::PADDING;
+    const size_t stride = Frame::WIDTH + 2 * pad;
+    const uint8_t* rgb = frame.get_data();
+    for (size_t y = 0; y < Frame::HEIGHT; y++) {
+        uint32_t* row = &source[(y + pad) * stride + pad];
+        const uint8_t* in = rgb + y * Frame::WIDTH * 3;
+        for (size_t x = 0; x < Frame::WIDTH; x++) {
+            row[x] = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+            in += 3;
+        }
+        std::fill(row - pad, row, row[0]);
+        std::fill(row + Frame::WIDTH, row + Frame::WIDTH + pad, row[Frame::WIDTH - 1]);
+    }
+    for (size_t i = 0; i < pad; i++) {
+        std::copy_n(&source[pad * stride], stride, &source[i * stride]);
+        std::copy_n(&source[(pad + Frame::HEIGHT - 1) * stride], stride,
+                    &source[(pad + Frame::HEIGHT + i) * stride]);
+    }
+}
+
+const uint32_t* FilterPipeline::process(const Frame& frame) {
+    prepare_source(frame);
+    FilterSource src{source.data(), Frame::WIDTH + 2 * FilterSource::PADDING,
+                     Frame::WIDTH, Frame::HEIGHT, frame.get_indices()};
+    filter->begin_frame();
+    // A few bands per thread keeps cores busy when some bands are cheaper.
+    size_t bands = std::min<size_t>(pool.size() * 4, Frame::HEIGHT);
+    size_t rows_per_band = (Frame::HEIGHT + bands - 1) / bands;
+    pool.parallel_for(bands, [&](size_t band) {
+        size_t row_begin = band * rows_per_band;
+        size_t row_end = std::min(row_begin + rows_per_band, Frame::HEIGHT);
+        if (row_begin < row_end) {
+            filter->apply(src, output.data(), width, row_begin, row_end);
+        }
+    });
+    return output.data();
+}
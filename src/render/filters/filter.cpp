@@ -0,0 +1,20 @@
+#include "render/filters/filter.h"
+#include "render/filters/scalex.h"
+#include "render/filters/hqx.h"
+#include "render/filters/xbr.h"
+#include "render/filters/ntsc.h"
+#include <stdexcept>
+
+std::unique_ptr<VideoFilter> make_filter(const std::string& name) {
+    if (name == "scale2x") return std::make_unique<ScaleXFilter>(2);
+    if (name == "scale3x") return std::make_unique<ScaleXFilter>(3);
+    if (name == "scale4x") return std::make_unique<ScaleXFilter>(4);
+    if (name == "hq2x") return std::make_unique<HqxFilter>(2);
+    if (name == "hq3x") return std::make_unique<HqxFilter>(3);
+    if (name == "hq4x") return std::make_unique<HqxFilter>(4);
+    if (name == "xbr2x") return std::make_unique<XbrFilter>(2);
+    if (name == "xbr3x") return std::make_unique<XbrFilter>(3);
+    if (name == "xbr4x") return std::make_unique<XbrFilter>(4);
+    if (name == "ntsc") return std::make_unique<NtscFilter>();
+    throw std::invalid_argument("Unknown video filter: " + name);
+}
@@ -0,0 +1,266 @@
+#include "render/filters/hqx.h"
+#include "render/filters/yuv_planes.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Per corner, four bits say what differs from the centre pixel E: the
+// horizontal neighbour H, the vertical neighbour V and the diagonal D,
+// plus whether H and V differ from each other (only tested when both
+// differ from E). Corner c points towards (sx, sy); bit 0 flips x and
+// bit 1 flips y.
+enum : uint8_t {
+    DIFF_H = 1,
+    DIFF_V = 2,
+    DIFF_D = 4,
+    DIFF_HV = 8,
+};
+
+inline ptrdiff_t corner_dx(int corner) { return (corner & 1) ? -1 : 1; }
+inline ptrdiff_t corner_dy(int corner) { return (corner & 2) ? -1 : 1; }
+
+// Sixteenths of E, H, V and D in the corner colour for each pattern.
+struct Rule {
+    uint8_t e, h, v, d;
+};
+
+constexpr Rule rule_for(uint8_t bits) {
+    bool h = bits & DIFF_H;
+    bool v = bits & DIFF_V;
+    bool d = bits & DIFF_D;
+    if (h && v) {
+        if (bits & DIFF_HV) {
+            // E is the tip of its area: round the corner off a little.
+            return d ? Rule{12, 0, 0, 4} : Rule{16, 0, 0, 0};
+        }
+        // An edge between H and V cuts the corner; a similar D means a
+        // thin diagonal line through E, which is kept sharp.
+        return d ? Rule{4, 6, 6, 0} : Rule{12, 2, 2, 0};
+    }
+    // A straight edge along one side is softened towards it.
+    if (h && d) {
+        return Rule{12, 4, 0, 0};
+    }
+    if (v && d) {
+        return Rule{12, 0, 4, 0};
+    }
+    return Rule{16, 0, 0, 0};
+}
+
+constexpr std::array<Rule, 16> make_rules() {
+    std::array<Rule, 16> rules{};
+    for (uint8_t bits = 0; bits < 16; bits++) {
+        rules[bits] = rule_for(bits);
+    }
+    return rules;
+}
+
+constexpr std::array<Rule, 16> RULES = make_rules();
+
+inline bool is_flat(uint16_t code) {
+    for (int corner = 0; corner < 4; corner++) {
+        if (RULES[(code >> (4 * corner)) & 0xF].e != 16) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t pixel_code(const YuvPlanes& yuv, size_t x, size_t y) {
+    const ptrdiff_t stride = yuv.stride();
+    const ptrdiff_t c = yuv.index(x, y);
+    uint16_t code = 0;
+    for (int corner = 0; corner < 4; corner++) {
+        ptrdiff_t h = c + corner_dx(corner);
+        ptrdiff_t v = c + corner_dy(corner) * stride;
+        ptrdiff_t d = v + corner_dx(corner);
+        bool dh = yuv.differs(c, h);
+        bool dv = yuv.differs(c, v);
+        uint16_t bits = (dh ? DIFF_H : 0) | (dv ? DIFF_V : 0) | (yuv.differs(c, d) ? DIFF_D : 0)
+                      | (dh && dv && yuv.differs(h, v) ? DIFF_HV : 0);
+        code |= bits << (4 * corner);
+    }
+    return code;
+}
+
+#if defined(__SSE2__)
+// pixel_code for pixels x..x+3.
+void pixel_codes4(const YuvPlanes& yuv, size_t x, size_t y, uint16_t* codes) {
+    const ptrdiff_t stride = yuv.stride();
+    const ptrdiff_t c = yuv.index(x, y);
+    auto differs = [&](ptrdiff_t dx, ptrdiff_t dy) { return yuv.differs4(c, c + dy * stride + dx); };
+    __m128i around[3][3];
+    __m128i any = _mm_setzero_si128();
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (dx != 0 || dy != 0) {
+                around[dy + 1][dx + 1] = differs(dx, dy);
+                any = _mm_or_si128(any, around[dy + 1][dx + 1]);
+            }
+        }
+    }
+    std::fill_n(codes, 4, 0);
+    // Flat areas, most of a typical frame, need nothing more.
+    if (_mm_movemask_epi8(any) == 0) {
+        return;
+    }
+    for (int corner = 0; corner < 4; corner++) {
+        ptrdiff_t sx = corner_dx(corner);
+        ptrdiff_t sy = corner_dy(corner);
+        __m128i dh = around[1][sx + 1];
+        __m128i dv = around[sy + 1][1];
+        __m128i dd = around[sy + 1][sx + 1];
+        __m128i dhv = _mm_and_si128(_mm_and_si128(dh, dv), yuv.differs4(c + sx, c + sy * stride));
+        int h = _mm_movemask_ps(_mm_castsi128_ps(dh));
+        int v = _mm_movemask_ps(_mm_castsi128_ps(dv));
+        int d = _mm_movemask_ps(_mm_castsi128_ps(dd));
+        int hv = _mm_movemask_ps(_mm_castsi128_ps(dhv));
+        for (int i = 0; i < 4; i++) {
+            uint16_t bits = ((h >> i) & 1) | ((v >> i) & 1) << 1 | ((d >> i) & 1) << 2 | ((hv >> i) & 1) << 3;
+            codes[i] |= bits << (4 * corner);
+        }
+    }
+}
+#endif
+
+struct Rgb {
+    int r, g, b;
+};
+
+inline Rgb to_rgb(uint32_t pixel) {
+    return {static_cast<int>((pixel >> 16) & 0xFF), static_cast<int>((pixel >> 8) & 0xFF),
+            static_cast<int>(pixel & 0xFF)};
+}
+
+inline uint32_t to_pixel(const Rgb& rgb) {
+    return static_cast<uint32_t>(rgb.r << 16 | rgb.g << 8 | rgb.b);
+}
+
+} // namespace
+
+HqxFilter::HqxFilter(size_t factor)
+    : factor(factor)
+    , subpixels{}
+{
+    if (factor < 2 || factor > 4) {
+        throw std::invalid_argument("hqx supports factors 2 to 4");
+    }
+    // Sub-pixels take their corner's colour in full from a third of the
+    // way out and fade to E towards the centre; ones on a middle row or
+    // column of an odd factor share the colours of the corners they touch.
+    for (size_t sy = 0; sy < factor; sy++) {
+        for (size_t sx = 0; sx < factor; sx++) {
+            float du = (sx + 0.5f) / factor - 0.5f;
+            float dv = (sy + 0.5f) / factor - 0.5f;
+            float strength = std::clamp((std::fabs(du) + std::fabs(dv) - 1.0f / 6) * 3.0f, 0.0f, 1.0f);
+            uint8_t x_corners = du > 0.01f ? 0b0101 : du < -0.01f ? 0b1010 : 0b1111;
+            uint8_t y_corners = dv > 0.01f ? 0b0011 : dv < -0.01f ? 0b1100 : 0b1111;
+            SubPixel& sub = subpixels[sy * factor + sx];
+            sub.weight = static_cast<uint16_t>(strength * 256.0f + 0.5f);
+            sub.corners = x_corners & y_corners;
+            sub.corner_count = static_cast<uint8_t>(__builtin_popcount(sub.corners));
+        }
+    }
+}
+
+#if defined(__SSE2__)
+// At 4x every sub-pixel lies in exactly one corner's quadrant, so each
+// output row is E blended with two corner colours, four pixels at once.
+void HqxFilter::blend_block4(uint32_t* out, size_t stride, uint32_t e, const uint32_t* corners) const {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i e16 = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(e)), zero);
+    for (size_t sy = 0; sy < 4; sy++) {
+        const SubPixel* sub = &subpixels[sy * 4];
+        int top = sy < 2 ? 2 : 0;
+        __m128i target = _mm_setr_epi32(static_cast<int>(corners[top + 1]), static_cast<int>(corners[top + 1]),
+                                         static_cast<int>(corners[top]), static_cast<int>(corners[top]));
+        __m128i w_lo = _mm_setr_epi16(sub[0].weight, sub[0].weight, sub[0].weight, sub[0].weight,
+                                      sub[1].weight, sub[1].weight, sub[1].weight, sub[1].weight);
+        __m128i w_hi = _mm_setr_epi16(sub[2].weight, sub[2].weight, sub[2].weight, sub[2].weight,
+                                      sub[3].weight, sub[3].weight, sub[3].weight, sub[3].weight);
+        __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(e16, _mm_sub_epi16(full, w_lo)),
+                                                  _mm_mullo_epi16(_mm_unpacklo_epi8(target, zero), w_lo)), 8);
+        __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(e16, _mm_sub_epi16(full, w_hi)),
+                                                  _mm_mullo_epi16(_mm_unpackhi_epi8(target, zero), w_hi)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + sy * stride), _mm_packus_epi16(lo, hi));
+    }
+}
+#endif
+
+// Pattern detection runs four pixels at a time; blocks with any corner to
+// interpolate are then built one pixel at a time.
+void HqxFilter::apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+                      size_t row_begin, size_t row_end) const {
+    thread_local YuvPlanes yuv;
+    thread_local std::vector<uint16_t> codes;
+    yuv.convert(src, row_begin, row_end);
+    codes.resize(src.width);
+
+    for (size_t y = row_begin; y < row_end; y++) {
+        size_t x = 0;
+#if defined(__SSE2__)
+        for (; x + 4 <= src.width; x += 4) {
+            pixel_codes4(yuv, x, y, &codes[x]);
+        }
+#endif
+        for (; x < src.width; x++) {
+            codes[x] = pixel_code(yuv, x, y);
+        }
+
+        const uint32_t* prow = src.row(y);
+        for (x = 0; x < src.width; x++) {
+            uint32_t* out = dst + y * factor * dst_stride + x * factor;
+            uint16_t code = codes[x];
+            if (code == 0 || is_flat(code)) {
+                fill_block(out, dst_stride, factor, prow[x]);
+                continue;
+            }
+            Rgb e = to_rgb(prow[x]);
+            uint32_t corners[4];
+            for (int corner = 0; corner < 4; corner++) {
+                ptrdiff_t sx = corner_dx(corner);
+                ptrdiff_t sy = corner_dy(corner);
+                const uint32_t* side_row = src.row(static_cast<ptrdiff_t>(y) + sy);
+                Rgb h = to_rgb(prow[x + sx]);
+                Rgb v = to_rgb(side_row[x]);
+                Rgb d = to_rgb(side_row[x + sx]);
+                const Rule& rule = RULES[(code >> (4 * corner)) & 0xF];
+                corners[corner] = to_pixel({
+                    (rule.e * e.r + rule.h * h.r + rule.v * v.r + rule.d * d.r) >> 4,
+                    (rule.e * e.g + rule.h * h.g + rule.v * v.g + rule.d * d.g) >> 4,
+                    (rule.e * e.b + rule.h * h.b + rule.v * v.b + rule.d * d.b) >> 4
+                });
+            }
+#if defined(__SSE2__)
+            if (factor == 4) {
+                blend_block4(out, dst_stride, prow[x], corners);
+                continue;
+            }
+#endif
+            for (size_t sy = 0; sy < factor; sy++) {
+                for (size_t sx = 0; sx < factor; sx++) {
+                    const SubPixel& sub = subpixels[sy * factor + sx];
+                    Rgb target = {0, 0, 0};
+                    for (int corner = 0; corner < 4; corner++) {
+                        if (sub.corners & (1 << corner)) {
+                            Rgb c = to_rgb(corners[corner]);
+                            target.r += c.r;
+                            target.g += c.g;
+                            target.b += c.b;
+                        }
+                    }
+                    int w = sub.weight;
+                    int n = sub.corner_count;
+                    int r = (e.r * (256 - w) + target.r / n * w) >> 8;
+                    int g = (e.g * (256 - w) + target.g / n * w) >> 8;
+                    int b = (e.b * (256 - w) + target.b / n * w) >> 8;
+                    out[sy * dst_stride + sx] = to_pixel({r, g, b});
+                }
+            }
+        }
+    }
+}
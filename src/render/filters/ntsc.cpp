@@ -0,0 +1,171 @@
+#include "render/filters/ntsc.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Composite voltages relative to sync (nesdev wiki, "NTSC video").
+constexpr float BLACK = 0.518f;
+constexpr float WHITE = 1.962f;
+constexpr float ATTENUATION = 0.746f;
+constexpr float LEVELS[8] = {
+    0.350f, 0.518f, 0.962f, 1.550f,  // signal low
+    1.094f, 1.506f, 1.962f, 1.962f   // signal high
+};
+// Decoder phase offset, in samples, lining the hues up with the colour burst.
+constexpr float HUE_OFFSET = 3.75f;
+
+inline uint32_t pack_rgb(float r, float g, float b) {
+    auto channel = [](float v) {
+        return static_cast<uint32_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+    };
+    return (channel(r) << 16) | (channel(g) << 8) | channel(b);
+}
+
+// FCC YIQ -> RGB for four pixels at once.
+void yiq_to_rgb4(const float* y, const float* i, const float* q, uint32_t* out) {
+#if defined(__SSE2__)
+    __m128 vy = _mm_loadu_ps(y);
+    __m128 vi = _mm_loadu_ps(i);
+    __m128 vq = _mm_loadu_ps(q);
+    auto channel = [&](float ci, float cq) {
+        __m128 v = _mm_add_ps(vy, _mm_add_ps(_mm_mul_ps(vi, _mm_set1_ps(ci)), _mm_mul_ps(vq, _mm_set1_ps(cq))));
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+    };
+    __m128i r = channel(0.956f, 0.621f);
+    __m128i g = channel(-0.272f, -0.647f);
+    __m128i b = channel(-1.106f, 1.703f);
+    __m128i rgb = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), rgb);
+#else
+    for (int k = 0; k < 4; k++) {
+        out[k] = pack_rgb(y[k] + 0.956f * i[k] + 0.621f * q[k],
+                          y[k] - 0.272f * i[k] - 0.647f * q[k],
+                          y[k] - 1.106f * i[k] + 1.703f * q[k]);
+    }
+#endif
+}
+
+} // namespace
+
+NtscFilter::NtscFilter()
+    : levels{}
+    , cos_table{}
+    , sin_table{}
+    , frame_phase(0)
+{
+    for (size_t pixel = 0; pixel < levels.size(); pixel++) {
+        int color = pixel & 0x0F;
+        int level = (pixel >> 4) & 0x03;
+        int emphasis = static_cast<int>(pixel >> 6);
+        if (color > 13) {
+            level = 1;
+        }
+        float low = LEVELS[level];
+        float high = LEVELS[4 + level];
+        if (color == 0) {
+            low = high;
+        }
+        if (color > 12) {
+            high = low;
+        }
+        for (size_t phase = 0; phase < PHASES; phase++) {
+            auto in_color_phase = [&](int c) { return (c + phase) % PHASES < 6; };
+            float signal = in_color_phase(color) ? high : low;
+            if (((emphasis & 1) && in_color_phase(0)) ||
+                ((emphasis & 2) && in_color_phase(4)) ||
+                ((emphasis & 4) && in_color_phase(8))) {
+                signal *= ATTENUATION;
+            }
+            float v = (signal - BLACK) / (WHITE - BLACK);
+            levels[pixel][phase] = v;
+            levels[pixel][phase + PHASES] = v;
+        }
+    }
+    // Chroma is demodulated over one colour cycle; the factor 2 restores
+    // the amplitude lost by averaging the product.
+    for (size_t phase = 0; phase < PHASES * 2; phase++) {
+        float angle = static_cast<float>(M_PI) * (phase + HUE_OFFSET) / 6.0f;
+        cos_table[phase] = 2.0f * std::cos(angle);
+        sin_table[phase] = 2.0f * std::sin(angle);
+    }
+}
+
+// A frame is 262 lines of 341 * 8 samples, 4 mod 12, and odd frames drop
+// one dot (8 samples), so the colour phase alternates between two values.
+void NtscFilter::begin_frame() {
+    frame_phase = (frame_phase + 4) % 8;
+}
+
+void NtscFilter::apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+                       size_t row_begin, size_t row_end) const {
+    const size_t width = src.width;
+    const size_t out_width = output_width(width);
+    // One padding pixel on each side keeps the decode window in bounds.
+    const size_t samples = (width + 2) * SAMPLES_PER_PIXEL;
+    thread_local std::vector<float> sum_y, sum_i, sum_q;
+    sum_y.resize(samples + 1);
+    sum_i.resize(samples + 1);
+    sum_q.resize(samples + 1);
+
+    for (size_t y = row_begin; y < row_end; y++) {
+        const uint16_t* line = src.indices + y * width;
+        // 341 dots of 8 samples per line is 4 mod 12.
+        size_t line_phase = (frame_phase + y * 4) % PHASES;
+        float acc_y = 0.0f, acc_i = 0.0f, acc_q = 0.0f;
+        sum_y[0] = sum_i[0] = sum_q[0] = 0.0f;
+        for (size_t px = 0; px < width + 2; px++) {
+            size_t x = std::clamp<size_t>(px, 1, width) - 1;
+            size_t phase = (line_phase + px * SAMPLES_PER_PIXEL + PHASES - SAMPLES_PER_PIXEL) % PHASES;
+            const float* level = &levels[line[x] & 0x1FF][phase];
+            alignas(16) float mi[SAMPLES_PER_PIXEL];
+            alignas(16) float mq[SAMPLES_PER_PIXEL];
+#if defined(__SSE2__)
+            __m128 l0 = _mm_loadu_ps(level);
+            __m128 l1 = _mm_loadu_ps(level + 4);
+            _mm_store_ps(mi, _mm_mul_ps(l0, _mm_loadu_ps(&cos_table[phase])));
+            _mm_store_ps(mi + 4, _mm_mul_ps(l1, _mm_loadu_ps(&cos_table[phase + 4])));
+            _mm_store_ps(mq, _mm_mul_ps(l0, _mm_loadu_ps(&sin_table[phase])));
+            _mm_store_ps(mq + 4, _mm_mul_ps(l1, _mm_loadu_ps(&sin_table[phase + 4])));
+#else
+            for (size_t k = 0; k < SAMPLES_PER_PIXEL; k++) {
+                mi[k] = level[k] * cos_table[phase + k];
+                mq[k] = level[k] * sin_table[phase + k];
+            }
+#endif
+            size_t base = px * SAMPLES_PER_PIXEL;
+            for (size_t k = 0; k < SAMPLES_PER_PIXEL; k++) {
+                acc_y += level[k];
+                acc_i += mi[k];
+                acc_q += mq[k];
+                sum_y[base + k + 1] = acc_y;
+                sum_i[base + k + 1] = acc_i;
+                sum_q[base + k + 1] = acc_q;
+            }
+        }
+
+        uint32_t* out = dst + y * dst_stride;
+        const float scale = 1.0f / PHASES;
+        for (size_t ox = 0; ox < out_width; ox += 4) {
+            alignas(16) float yy[4] = {}, ii[4] = {}, qq[4] = {};
+            alignas(16) uint32_t rgb[4];
+            size_t count = std::min<size_t>(4, out_width - ox);
+            for (size_t k = 0; k < count; k++) {
+                size_t center = ((2 * (ox + k) + 1) * width * SAMPLES_PER_PIXEL) / (2 * out_width)
+                              + SAMPLES_PER_PIXEL;
+                size_t lo = center - PHASES / 2;
+                size_t hi = center + PHASES / 2;
+                yy[k] = (sum_y[hi] - sum_y[lo]) * scale;
+                ii[k] = (sum_i[hi] - sum_i[lo]) * scale;
+                qq[k] = (sum_q[hi] - sum_q[lo]) * scale;
+            }
+            yiq_to_rgb4(yy, ii, qq, rgb);
+            std::copy_n(rgb, count, out + ox);
+        }
+    }
+}
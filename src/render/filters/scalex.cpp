@@ -0,0 +1,144 @@
+#include "render/filters/scalex.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__SSE2__)
+inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+// One source row -> two output rows. above/row/below must be readable at
+// [-1] and [width].
+void scale2x_row(const uint32_t* above, const uint32_t* row, const uint32_t* below,
+                 uint32_t* out0, uint32_t* out1, size_t width) {
+    size_t x = 0;
+#if defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (; x + 4 <= width; x += 4) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+        __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1));
+        __m128i active = _mm_andnot_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), ones);
+        __m128i e0 = select(_mm_and_si128(active, _mm_cmpeq_epi32(d, b)), d, e);
+        __m128i e1 = select(_mm_and_si128(active, _mm_cmpeq_epi32(b, f)), f, e);
+        __m128i e2 = select(_mm_and_si128(active, _mm_cmpeq_epi32(d, h)), d, e);
+        __m128i e3 = select(_mm_and_si128(active, _mm_cmpeq_epi32(h, f)), f, e);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x), _mm_unpacklo_epi32(e0, e1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x + 4), _mm_unpackhi_epi32(e0, e1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x), _mm_unpacklo_epi32(e2, e3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x + 4), _mm_unpackhi_epi32(e2, e3));
+    }
+#endif
+    for (; x < width; x++) {
+        uint32_t b = above[x], h = below[x];
+        uint32_t d = row[x - 1], e = row[x], f = row[x + 1];
+        if (b != h && d != f) {
+            out0[2 * x] = d == b ? d : e;
+            out0[2 * x + 1] = b == f ? f : e;
+            out1[2 * x] = d == h ? d : e;
+            out1[2 * x + 1] = h == f ? f : e;
+        } else {
+            out0[2 * x] = out0[2 * x + 1] = e;
+            out1[2 * x] = out1[2 * x + 1] = e;
+        }
+    }
+}
+
+void scale3x_row(const uint32_t* above, const uint32_t* row, const uint32_t* below,
+                 uint32_t* out0, uint32_t* out1, uint32_t* out2, size_t width) {
+    for (size_t x = 0; x < width; x++) {
+        uint32_t a = above[x - 1], b = above[x], c = above[x + 1];
+        uint32_t d = row[x - 1], e = row[x], f = row[x + 1];
+        uint32_t g = below[x - 1], h = below[x], i = below[x + 1];
+        uint32_t* o0 = out0 + 3 * x;
+        uint32_t* o1 = out1 + 3 * x;
+        uint32_t* o2 = out2 + 3 * x;
+        if (b != h && d != f) {
+            o0[0] = d == b ? d : e;
+            o0[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+            o0[2] = b == f ? f : e;
+            o1[0] = (d == b && e != g) || (d == h && e != a) ? d : e;
+            o1[1] = e;
+            o1[2] = (b == f && e != i) || (h == f && e != c) ? f : e;
+            o2[0] = d == h ? d : e;
+            o2[1] = (d == h && e != i) || (h == f && e != g) ? h : e;
+            o2[2] = h == f ? f : e;
+        } else {
+            o0[0] = o0[1] = o0[2] = e;
+            o1[0] = o1[1] = o1[2] = e;
+            o2[0] = o2[1] = o2[2] = e;
+        }
+    }
+}
+
+// Scale4x needs the 2x rows just above and below the band, so each band
+// rebuilds its own slice of the intermediate image in scratch memory.
+void scale4x_band(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+                  size_t row_begin, size_t row_end) {
+    thread_local std::vector<uint32_t> scratch;
+    const size_t width2 = src.width * 2;
+    const size_t stride2 = width2 + 2;
+    const size_t rows2 = (row_end - row_begin + 2) * 2;
+    scratch.resize(stride2 * rows2);
+    auto mid_row = [&](size_t i) { return scratch.data() + i * stride2 + 1; };
+
+    for (ptrdiff_t y = static_cast<ptrdiff_t>(row_begin) - 1; y <= static_cast<ptrdiff_t>(row_end); y++) {
+        size_t i = static_cast<size_t>(y - (static_cast<ptrdiff_t>(row_begin) - 1)) * 2;
+        scale2x_row(src.row(y - 1), src.row(y), src.row(y + 1), mid_row(i), mid_row(i + 1), src.width);
+    }
+    if (row_begin == 0) {
+        std::copy(mid_row(2), mid_row(2) + width2, mid_row(1));
+    }
+    if (row_end == src.height) {
+        std::copy(mid_row(rows2 - 3), mid_row(rows2 - 3) + width2, mid_row(rows2 - 2));
+    }
+    for (size_t i = 0; i < rows2; i++) {
+        uint32_t* r = mid_row(i);
+        r[-1] = r[0];
+        r[width2] = r[width2 - 1];
+    }
+    for (size_t i = 2; i < rows2 - 2; i++) {
+        size_t out_y = (row_begin * 2 + i - 2) * 2;
+        scale2x_row(mid_row(i - 1), mid_row(i), mid_row(i + 1),
+                    dst + out_y * dst_stride, dst + (out_y + 1) * dst_stride, width2);
+    }
+}
+
+} // namespace
+
+ScaleXFilter::ScaleXFilter(size_t factor)
+    : factor(factor)
+{
+    if (factor < 2 || factor > 4) {
+        throw std::invalid_argument("ScaleX supports factors 2 to 4");
+    }
+}
+
+void ScaleXFilter::apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+                         size_t row_begin, size_t row_end) const {
+    if (factor == 4) {
+        scale4x_band(src, dst, dst_stride, row_begin, row_end);
+        return;
+    }
+    for (size_t y = row_begin; y < row_end; y++) {
+        const uint32_t* above = src.row(static_cast<ptrdiff_t>(y) - 1);
+        const uint32_t* row = src.row(y);
+        const uint32_t* below = src.row(y + 1);
+        uint32_t* out = dst + y * factor * dst_stride;
+        if (factor == 2) {
+            scale2x_row(above, row, below, out, out + dst_stride, src.width);
+        } else {
+            scale3x_row(above, row, below, out, out + dst_stride, out + 2 * dst_stride, src.width);
+        }
+    }
+}
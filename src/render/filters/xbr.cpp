@@ -0,0 +1,157 @@
+#include "render/filters/xbr.h"
+#include "render/filters/yuv_planes.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+inline uint32_t blend(uint32_t a, uint32_t b, uint32_t weight) {
+    uint32_t rb = ((a & 0xFF00FF) * (256 - weight) + (b & 0xFF00FF) * weight) >> 8;
+    uint32_t g = ((a & 0x00FF00) * (256 - weight) + (b & 0x00FF00) * weight) >> 8;
+    return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+// Corner c points towards (sx, sy); bit 0 flips x and bit 1 flips y.
+inline ptrdiff_t corner_dx(int corner) { return (corner & 1) ? -1 : 1; }
+inline ptrdiff_t corner_dy(int corner) { return (corner & 2) ? -1 : 1; }
+
+// Bit c set when the level 1 rule fires for corner c of pixel x on row y:
+// the pixel differs from both neighbours on that side and the edge running
+// through them is weaker across than along.
+uint8_t corner_mask(const FilterSource& src, const YuvPlanes& yuv, size_t x, size_t y) {
+    const ptrdiff_t stride = yuv.stride();
+    const ptrdiff_t c = yuv.index(x, y);
+    const uint32_t e = src.row(y)[x];
+    uint8_t mask = 0;
+    for (int corner = 0; corner < 4; corner++) {
+        ptrdiff_t sx = corner_dx(corner);
+        ptrdiff_t sy = corner_dy(corner);
+        if (src.row(y)[x + sx] == e || src.row(static_cast<ptrdiff_t>(y) + sy)[x] == e) {
+            continue;
+        }
+        auto at = [&](ptrdiff_t dx, ptrdiff_t dy) { return c + dy * stride + dx; };
+        int edge = yuv.distance(c, at(sx, -sy)) + yuv.distance(c, at(-sx, sy))
+                 + yuv.distance(at(sx, sy), at(0, 2 * sy)) + yuv.distance(at(sx, sy), at(2 * sx, 0))
+                 + 4 * yuv.distance(at(0, sy), at(sx, 0));
+        int across = yuv.distance(at(0, sy), at(-sx, 0)) + yuv.distance(at(0, sy), at(sx, 2 * sy))
+                   + yuv.distance(at(sx, 0), at(2 * sx, sy)) + yuv.distance(at(sx, 0), at(0, -sy))
+                   + 4 * yuv.distance(c, at(sx, sy));
+        if (edge < across) {
+            mask |= 1 << corner;
+        }
+    }
+    return mask;
+}
+
+#if defined(__SSE2__)
+// corner_mask for pixels x..x+3.
+void corner_masks4(const FilterSource& src, const YuvPlanes& yuv, size_t x, size_t y, uint8_t* masks) {
+    const ptrdiff_t stride = yuv.stride();
+    const ptrdiff_t c = yuv.index(x, y);
+    auto load = [&](ptrdiff_t dx, ptrdiff_t dy) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.row(static_cast<ptrdiff_t>(y) + dy) + x + dx));
+    };
+    const __m128i e = load(0, 0);
+    std::fill_n(masks, 4, 0);
+    for (int corner = 0; corner < 4; corner++) {
+        ptrdiff_t sx = corner_dx(corner);
+        ptrdiff_t sy = corner_dy(corner);
+        auto at = [&](ptrdiff_t dx, ptrdiff_t dy) { return c + dy * stride + dx; };
+        __m128i same = _mm_or_si128(_mm_cmpeq_epi32(load(sx, 0), e), _mm_cmpeq_epi32(load(0, sy), e));
+        // Flat areas, most of a typical frame, skip the distances.
+        if (_mm_movemask_epi8(same) == 0xFFFF) {
+            continue;
+        }
+        __m128i edge = _mm_add_epi32(
+            _mm_add_epi32(yuv.distance4(c, at(sx, -sy)), yuv.distance4(c, at(-sx, sy))),
+            _mm_add_epi32(_mm_add_epi32(yuv.distance4(at(sx, sy), at(0, 2 * sy)),
+                                        yuv.distance4(at(sx, sy), at(2 * sx, 0))),
+                          _mm_slli_epi32(yuv.distance4(at(0, sy), at(sx, 0)), 2)));
+        __m128i across = _mm_add_epi32(
+            _mm_add_epi32(yuv.distance4(at(0, sy), at(-sx, 0)), yuv.distance4(at(0, sy), at(sx, 2 * sy))),
+            _mm_add_epi32(_mm_add_epi32(yuv.distance4(at(sx, 0), at(2 * sx, sy)),
+                                        yuv.distance4(at(sx, 0), at(0, -sy))),
+                          _mm_slli_epi32(yuv.distance4(c, at(sx, sy)), 2)));
+        __m128i fires = _mm_andnot_si128(same, _mm_cmplt_epi32(edge, across));
+        int lanes = _mm_movemask_ps(_mm_castsi128_ps(fires));
+        for (int i = 0; i < 4; i++) {
+            masks[i] |= ((lanes >> i) & 1) << corner;
+        }
+    }
+}
+#endif
+
+} // namespace
+
+XbrFilter::XbrFilter(size_t factor)
+    : factor(factor)
+    , corner_weights{}
+{
+    if (factor < 2 || factor > 4) {
+        throw std::invalid_argument("xBR supports factors 2 to 4");
+    }
+    // The level 1 edge runs from the middle of the bottom side to the middle
+    // of the right side; sub-pixels are weighted by how far past it they sit.
+    for (size_t sy = 0; sy < factor; sy++) {
+        for (size_t sx = 0; sx < factor; sx++) {
+            float u = (sx + 0.5f) / factor;
+            float v = (sy + 0.5f) / factor;
+            float coverage = std::clamp((u + v - 1.5f) * factor / 2.0f + 0.5f, 0.0f, 1.0f);
+            corner_weights[sy * factor + sx] = static_cast<uint16_t>(coverage * 256.0f + 0.5f);
+        }
+    }
+}
+
+// Rule evaluation, which is most of the work, runs four pixels at a time;
+// the rare pixels with a firing corner are then blended one by one.
+void XbrFilter::apply(const FilterSource& src, uint32_t* dst, size_t dst_stride,
+                      size_t row_begin, size_t row_end) const {
+    thread_local YuvPlanes yuv;
+    thread_local std::vector<uint8_t> masks;
+    yuv.convert(src, row_begin, row_end);
+    masks.resize(src.width);
+
+    for (size_t y = row_begin; y < row_end; y++) {
+        size_t x = 0;
+#if defined(__SSE2__)
+        for (; x + 4 <= src.width; x += 4) {
+            corner_masks4(src, yuv, x, y, &masks[x]);
+        }
+#endif
+        for (; x < src.width; x++) {
+            masks[x] = corner_mask(src, yuv, x, y);
+        }
+
+        const uint32_t* prow = src.row(y);
+        const ptrdiff_t c0 = yuv.index(0, y);
+        for (x = 0; x < src.width; x++) {
+            uint32_t e = prow[x];
+            uint32_t* out = dst + y * factor * dst_stride + x * factor;
+            fill_block(out, dst_stride, factor, e);
+            for (int corner = 0; corner < 4; corner++) {
+                if (!(masks[x] & (1 << corner))) {
+                    continue;
+                }
+                ptrdiff_t sx = corner_dx(corner);
+                ptrdiff_t sy = corner_dy(corner);
+                ptrdiff_t c = c0 + static_cast<ptrdiff_t>(x);
+                uint32_t f = prow[x + sx];
+                uint32_t h = src.row(static_cast<ptrdiff_t>(y) + sy)[x];
+                uint32_t px = yuv.distance(c, c + sx) <= yuv.distance(c, c + sy * yuv.stride()) ? f : h;
+                for (size_t wy = 0; wy < factor; wy++) {
+                    size_t oy = sy > 0 ? wy : factor - 1 - wy;
+                    for (size_t wx = 0; wx < factor; wx++) {
+                        uint16_t weight = corner_weights[wy * factor + wx];
+                        if (weight == 0) {
+                            continue;
+                        }
+                        size_t ox = sx > 0 ? wx : factor - 1 - wx;
+                        uint32_t& target = out[oy * dst_stride + ox];
+                        target = blend(target, px, weight);
+                    }
+                }
+            }
+        }
+    }
+}
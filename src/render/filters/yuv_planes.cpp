@@ -0,0 +1,31 @@
+#include "render/filters/yuv_planes.h"
+
+YuvPlanes::YuvPlanes()
+    : y_plane()
+    , u_plane()
+    , v_plane()
+    , plane_stride(0)
+    , first_row(0)
+{
+}
+
+void YuvPlanes::convert(const FilterSource& src, size_t row_begin, size_t row_end) {
+    plane_stride = static_cast<ptrdiff_t>(src.width) + 2 * PAD;
+    first_row = row_begin;
+    const size_t rows = row_end - row_begin + 2 * PAD;
+    y_plane.resize(plane_stride * rows);
+    u_plane.resize(plane_stride * rows);
+    v_plane.resize(plane_stride * rows);
+    for (size_t i = 0; i < rows; i++) {
+        const uint32_t* row = src.row(static_cast<ptrdiff_t>(row_begin + i) - PAD) - PAD;
+        for (ptrdiff_t x = 0; x < plane_stride; x++) {
+            int r = (row[x] >> 16) & 0xFF;
+            int g = (row[x] >> 8) & 0xFF;
+            int b = row[x] & 0xFF;
+            ptrdiff_t at = i * plane_stride + x;
+            y_plane[at] = (77 * r + 150 * g + 29 * b) >> 8;
+            u_plane[at] = (-43 * r - 85 * g + 128 * b) >> 8;
+            v_plane[at] = (128 * r - 107 * g - 21 * b) >> 8;
+        }
+    }
+}
@@ -1,7 +1,9 @@
 #include "render/frame.h"
+#include "render/palette.h"
 
 Frame::Frame() 
     : data{}  
+    , indices{}
 {}
 
 void Frame::set_pixel(size_t x, size_t y, uint8_t r, uint8_t g, uint8_t b) {
@@ -17,3 +19,11 @@ void Frame::set_pixel(size_t x, size_t y, uint8_t r, uint8_t g, uint8_t b) {
 void Frame::set_pixel(size_t x, size_t y, const std::array<uint8_t, 3>& rgb) {
     set_pixel(x, y, rgb[0], rgb[1], rgb[2]);
 }
+
+void Frame::set_palette_pixel(size_t x, size_t y, uint16_t nes_pixel) {
+    if (x >= WIDTH || y >= HEIGHT) {
+        return;
+    }
+    indices[y * WIDTH + x] = nes_pixel;
+    set_pixel(x, y, Palette::get_color(nes_pixel & 0x3F));
+}
@@ -0,0 +1,184 @@
+#include "rewind_buffer.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// A delta is a sequence of (zero run, literal run) pairs, each length a
+// LEB128 varint, followed by the literal bytes to XOR in.
+
+namespace {
+
+uint8_t* put_varint(uint8_t* out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+const uint8_t* get_varint(const uint8_t* in, size_t& value) {
+    value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = *in++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return in;
+}
+
+// Every pair costs at most two 10-byte varints, and a literal run only
+// ends at a zero byte, so pairs never outnumber half the input plus one.
+size_t max_encoded_size(size_t state_size) {
+    return state_size + (state_size / 2 + 1) * 20;
+}
+
+}
+
+RewindBuffer::RewindBuffer(size_t state_size, size_t max_states, size_t capacity_bytes)
+    : current(state_size)
+    , ring(std::max(capacity_bytes, max_encoded_size(state_size)))
+    , scratch(max_encoded_size(state_size))
+    , records(std::max<size_t>(max_states, 2) - 1)
+    , first_record(0)
+    , record_count(0)
+    , ring_head(0)
+    , used(0)
+    , count(0)
+{
+    if (state_size == 0) {
+        throw std::invalid_argument("Rewind states cannot be empty");
+    }
+}
+
+void RewindBuffer::clear() {
+    first_record = 0;
+    record_count = 0;
+    ring_head = 0;
+    used = 0;
+    count = 0;
+}
+
+// XORs state into current while encoding the difference into scratch, so
+// current ends up holding state. Zero bytes are skipped eight at a time.
+size_t RewindBuffer::encode_delta(std::span<const uint8_t> state) {
+    const uint8_t* in = state.data();
+    uint8_t* cur = current.data();
+    size_t n = current.size();
+    uint8_t* out = scratch.data();
+    size_t pos = 0;
+    while (pos < n) {
+        size_t zero_start = pos;
+        while (pos + 8 <= n) {
+            uint64_t a, b;
+            std::memcpy(&a, in + pos, 8);
+            std::memcpy(&b, cur + pos, 8);
+            if (a != b) {
+                break;
+            }
+            pos += 8;
+        }
+        while (pos < n && in[pos] == cur[pos]) {
+            pos++;
+        }
+        if (pos == n) {
+            break;
+        }
+        out = put_varint(out, pos - zero_start);
+        size_t literal_start = pos;
+        while (pos < n && in[pos] != cur[pos]) {
+            pos++;
+        }
+        size_t literal_length = pos - literal_start;
+        out = put_varint(out, literal_length);
+        for (size_t i = literal_start; i < pos; i++) {
+            *out++ = in[i] ^ cur[i];
+        }
+        std::memcpy(cur + literal_start, in + literal_start, literal_length);
+    }
+    return out - scratch.data();
+}
+
+void RewindBuffer::apply_delta(const uint8_t* delta, size_t length) {
+    const uint8_t* end = delta + length;
+    uint8_t* cur = current.data();
+    size_t pos = 0;
+    while (delta < end) {
+        size_t zeros, literals;
+        delta = get_varint(delta, zeros);
+        delta = get_varint(delta, literals);
+        pos += zeros;
+        for (size_t i = 0; i < literals; i++) {
+            cur[pos + i] ^= delta[i];
+        }
+        delta += literals;
+        pos += literals;
+    }
+}
+
+void RewindBuffer::drop_oldest() {
+    const Record& oldest = records[first_record];
+    used -= oldest.length;
+    first_record = (first_record + 1) % records.size();
+    record_count--;
+    count--;
+}
+
+void RewindBuffer::push(std::span<const uint8_t> state) {
+    if (state.size() != current.size()) {
+        throw std::invalid_argument("Rewind state has the wrong size");
+    }
+    if (count == 0) {
+        std::memcpy(current.data(), state.data(), state.size());
+        count = 1;
+        return;
+    }
+    size_t length = encode_delta(state);
+    // Deltas are packed back to back around the ring, so the free space
+    // is everything not in use.
+    while (record_count > 0 && (record_count == records.size() || length > ring.size() - used)) {
+        drop_oldest();
+    }
+    if (record_count == 0) {
+        ring_head = 0;
+    }
+    size_t first_part = std::min(length, ring.size() - ring_head);
+    std::memcpy(ring.data() + ring_head, scratch.data(), first_part);
+    std::memcpy(ring.data(), scratch.data() + first_part, length - first_part);
+    records[(first_record + record_count) % records.size()] = Record{ring_head, length};
+    record_count++;
+    ring_head = (ring_head + length) % ring.size();
+    used += length;
+    count++;
+}
+
+bool RewindBuffer::pop(std::span<uint8_t> state) {
+    if (state.size() != current.size()) {
+        throw std::invalid_argument("Rewind state has the wrong size");
+    }
+    if (count == 0) {
+        return false;
+    }
+    std::memcpy(state.data(), current.data(), current.size());
+    if (record_count == 0) {
+        count = 0;
+        return true;
+    }
+    size_t newest = (first_record + record_count - 1) % records.size();
+    Record record = records[newest];
+    const uint8_t* delta = ring.data() + record.offset;
+    if (record.offset + record.length > ring.size()) {
+        size_t first_part = ring.size() - record.offset;
+        std::memcpy(scratch.data(), delta, first_part);
+        std::memcpy(scratch.data() + first_part, ring.data(), record.length - first_part);
+        delta = scratch.data();
+    }
+    apply_delta(delta, record.length);
+    record_count--;
+    ring_head = record.offset;
+    used -= record.length;
+    count--;
+    return true;
+}
@@ -0,0 +1,79 @@
+#include "rom_image.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomImage::RomImage()
+    : bytes(nullptr)
+    , length(0)
+    , owned()
+    , mapping(nullptr)
+{}
+
+RomImage::~RomImage() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapping) {
+        ::munmap(mapping, length);
+    }
+#endif
+}
+
+std::shared_ptr<const RomImage> RomImage::from_bytes(std::vector<uint8_t> data) {
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->owned = std::move(data);
+    image->bytes = image->owned.data();
+    image->length = image->owned.size();
+    return image;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+std::shared_ptr<const RomImage> RomImage::map_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not read file: " + path);
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        return from_bytes({});
+    }
+    void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Could not map file: " + path);
+    }
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->mapping = mapped;
+    image->bytes = static_cast<const uint8_t*>(mapped);
+    image->length = static_cast<size_t>(info.st_size);
+    return image;
+}
+
+#else
+
+std::shared_ptr<const RomImage> RomImage::map_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<uint8_t> data(size);
+    if (!file.read(reinterpret_cast<char*>(data.data()), size)) {
+        throw std::runtime_error("Could not read file: " + path);
+    }
+    return from_bytes(std::move(data));
+}
+
+#endif
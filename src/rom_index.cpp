@@ -0,0 +1,379 @@
+#include "rom_index.h"
+#include "rom_image.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'N', 'E', 'S', 'I', 'D', 'X', 0, 0};
+const uint32_t INDEX_VERSION = 1;
+const size_t INDEX_HEADER_SIZE = 24;
+const size_t ENTRY_RECORD_SIZE = 72;
+const size_t FIX_RECORD_SIZE = 12;
+
+const uint8_t FLAG_BATTERY = 0x01;
+const uint8_t FLAG_NES2 = 0x02;
+const uint8_t FLAG_VALID = 0x04;
+
+class Writer {
+public:
+    std::vector<uint8_t> bytes;
+    void put(uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            bytes.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+    void put_bytes(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), p, p + size);
+    }
+};
+
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& data) : bytes(data), pos(0) {}
+    uint64_t get(size_t size) {
+        need(size);
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; i++) {
+            value |= static_cast<uint64_t>(bytes[pos + i]) << (i * 8);
+        }
+        pos += size;
+        return value;
+    }
+    void get_bytes(void* out, size_t size) {
+        need(size);
+        std::memcpy(out, &bytes[pos], size);
+        pos += size;
+    }
+    size_t remaining() const { return bytes.size() - pos; }
+private:
+    const std::vector<uint8_t>& bytes;
+    size_t pos;
+    void need(size_t size) const {
+        if (size > remaining()) {
+            throw std::runtime_error("ROM index is truncated");
+        }
+    }
+};
+
+bool is_rom_file(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return ext == ".nes";
+}
+
+struct FoundFile {
+    std::string path;
+    int64_t mtime;
+    uint64_t size;
+};
+
+// Fills in size and mtime; returns false for files that vanished or
+// cannot be stat'd.
+bool stat_file(const fs::directory_entry& entry, FoundFile& found) {
+    std::error_code error;
+    found.size = entry.file_size(error);
+    if (error) {
+        return false;
+    }
+    auto mtime = entry.last_write_time(error);
+    if (error) {
+        return false;
+    }
+    found.path = entry.path().string();
+    found.mtime = mtime.time_since_epoch().count();
+    return true;
+}
+
+// Breadth-first walk with one pool job per directory of the current level.
+std::vector<FoundFile> walk(const std::vector<std::string>& roots, ThreadPool& pool) {
+    std::vector<FoundFile> files;
+    std::vector<fs::path> level;
+    for (const auto& root : roots) {
+        std::error_code error;
+        fs::directory_entry entry(root, error);
+        if (error) {
+            continue;
+        }
+        if (entry.is_directory(error)) {
+            level.push_back(entry.path());
+        } else if (entry.is_regular_file(error)) {
+            FoundFile found;
+            if (stat_file(entry, found)) {
+                files.push_back(std::move(found));
+            }
+        }
+    }
+    while (!level.empty()) {
+        std::vector<std::vector<FoundFile>> level_files(level.size());
+        std::vector<std::vector<fs::path>> level_dirs(level.size());
+        pool.parallel_for(level.size(), [&](size_t i) {
+            std::error_code error;
+            for (fs::directory_iterator it(level[i], error), end; !error && it != end; it.increment(error)) {
+                std::error_code type_error;
+                if (it->is_directory(type_error)) {
+                    level_dirs[i].push_back(it->path());
+                } else if (it->is_regular_file(type_error) && is_rom_file(it->path())) {
+                    FoundFile found;
+                    if (stat_file(*it, found)) {
+                        level_files[i].push_back(std::move(found));
+                    }
+                }
+            }
+        });
+        level.clear();
+        for (size_t i = 0; i < level_files.size(); i++) {
+            std::move(level_files[i].begin(), level_files[i].end(), std::back_inserter(files));
+            std::move(level_dirs[i].begin(), level_dirs[i].end(), std::back_inserter(level));
+        }
+    }
+    return files;
+}
+
+void hash_file(RomIndexEntry& entry) {
+    entry.valid = false;
+    try {
+        Rom rom = Rom::create(RomImage::map_file(entry.path));
+        entry.prg_size = static_cast<uint32_t>(rom.prg_rom.size());
+        entry.chr_size = static_cast<uint32_t>(rom.chr_rom.size());
+        entry.prg_crc32 = crc32(rom.prg_rom);
+        entry.chr_crc32 = crc32(rom.chr_rom);
+        entry.rom_crc32 = crc32(rom.chr_rom, entry.prg_crc32);
+        Sha1 sha;
+        sha.update(rom.prg_rom);
+        sha.update(rom.chr_rom);
+        entry.rom_sha1 = sha.finish();
+        entry.mapper = rom.mapper;
+        entry.submapper = rom.submapper;
+        entry.mirroring = rom.screen_mirroring;
+        entry.battery = rom.battery;
+        entry.nes2 = rom.nes2;
+        entry.valid = true;
+    } catch (const std::runtime_error&) {
+        // Kept as an invalid entry so unchanged bad files are not retried.
+    }
+}
+
+// The value ends up in NesPPU::set_mirroring(), which indexes a table
+// with it.
+Mirroring get_mirroring(Reader& in, const std::string& path) {
+    uint8_t value = in.get(1);
+    if (value > static_cast<uint8_t>(Mirroring::SingleScreenUpper)) {
+        throw std::runtime_error("ROM index has an invalid mirroring: " + path);
+    }
+    return static_cast<Mirroring>(value);
+}
+
+}
+
+RomIndex RomIndex::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open ROM index: " + path);
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    Reader in(data);
+    char magic[8];
+    in.get_bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a ROM index: " + path);
+    }
+    if (in.get(4) != INDEX_VERSION) {
+        throw std::runtime_error("Unsupported ROM index version: " + path);
+    }
+    size_t entry_count = in.get(4);
+    size_t fix_count = in.get(4);
+    size_t string_bytes = in.get(4);
+    if (in.remaining() != entry_count * ENTRY_RECORD_SIZE + fix_count * FIX_RECORD_SIZE + string_bytes) {
+        throw std::runtime_error("ROM index has the wrong size: " + path);
+    }
+    const char* strings = reinterpret_cast<const char*>(data.data()) + data.size() - string_bytes;
+
+    RomIndex index;
+    index.entries.resize(entry_count);
+    for (auto& entry : index.entries) {
+        size_t offset = in.get(4);
+        size_t length = in.get(4);
+        if (offset > string_bytes || length > string_bytes - offset) {
+            throw std::runtime_error("ROM index has a bad path: " + path);
+        }
+        entry.path.assign(strings + offset, length);
+        entry.mtime = static_cast<int64_t>(in.get(8));
+        entry.file_size = in.get(8);
+        entry.prg_size = in.get(4);
+        entry.chr_size = in.get(4);
+        entry.prg_crc32 = in.get(4);
+        entry.chr_crc32 = in.get(4);
+        entry.rom_crc32 = in.get(4);
+        in.get_bytes(entry.rom_sha1.data(), entry.rom_sha1.size());
+        entry.mapper = in.get(2);
+        entry.submapper = in.get(1);
+        entry.mirroring = get_mirroring(in, path);
+        uint8_t flags = in.get(1);
+        entry.battery = flags & FLAG_BATTERY;
+        entry.nes2 = flags & FLAG_NES2;
+        entry.valid = flags & FLAG_VALID;
+        in.get(3);
+    }
+    index.fixes.resize(fix_count);
+    for (auto& fix : index.fixes) {
+        fix.rom_crc32 = in.get(4);
+        fix.mapper = in.get(2);
+        fix.submapper = in.get(1);
+        fix.mirroring = get_mirroring(in, path);
+        fix.battery = in.get(1) & FLAG_BATTERY;
+        in.get(3);
+    }
+    // find_fix() and set_fix() binary-search the table.
+    for (size_t i = 1; i < index.fixes.size(); i++) {
+        if (index.fixes[i - 1].rom_crc32 >= index.fixes[i].rom_crc32) {
+            throw std::runtime_error("ROM index fixes are not sorted: " + path);
+        }
+    }
+    return index;
+}
+
+void RomIndex::save(const std::string& path) const {
+    Writer strings;
+    Writer out;
+    out.put_bytes(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    out.put(INDEX_VERSION, 4);
+    out.put(entries.size(), 4);
+    out.put(fixes.size(), 4);
+    size_t string_size_at = out.bytes.size();
+    out.put(0, 4);
+    for (const auto& entry : entries) {
+        out.put(strings.bytes.size(), 4);
+        out.put(entry.path.size(), 4);
+        strings.put_bytes(entry.path.data(), entry.path.size());
+        out.put(static_cast<uint64_t>(entry.mtime), 8);
+        out.put(entry.file_size, 8);
+        out.put(entry.prg_size, 4);
+        out.put(entry.chr_size, 4);
+        out.put(entry.prg_crc32, 4);
+        out.put(entry.chr_crc32, 4);
+        out.put(entry.rom_crc32, 4);
+        out.put_bytes(entry.rom_sha1.data(), entry.rom_sha1.size());
+        out.put(entry.mapper, 2);
+        out.put(entry.submapper, 1);
+        out.put(static_cast<uint8_t>(entry.mirroring), 1);
+        out.put((entry.battery ? FLAG_BATTERY : 0) | (entry.nes2 ? FLAG_NES2 : 0)
+                | (entry.valid ? FLAG_VALID : 0), 1);
+        out.put(0, 3);
+    }
+    for (const auto& fix : fixes) {
+        out.put(fix.rom_crc32, 4);
+        out.put(fix.mapper, 2);
+        out.put(fix.submapper, 1);
+        out.put(static_cast<uint8_t>(fix.mirroring), 1);
+        out.put(fix.battery ? FLAG_BATTERY : 0, 1);
+        out.put(0, 3);
+    }
+    for (size_t i = 0; i < 4; i++) {
+        out.bytes[string_size_at + i] = static_cast<uint8_t>(strings.bytes.size() >> (i * 8));
+    }
+    out.bytes.insert(out.bytes.end(), strings.bytes.begin(), strings.bytes.end());
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(out.bytes.data()), out.bytes.size())) {
+            throw std::runtime_error("Could not write ROM index: " + temp_path);
+        }
+    }
+    std::error_code error;
+    fs::rename(temp_path, path, error);
+    if (error) {
+        throw std::runtime_error("Could not replace ROM index: " + path);
+    }
+}
+
+ScanStats RomIndex::scan(const std::vector<std::string>& roots, ThreadPool& pool) {
+    std::vector<FoundFile> files = walk(roots, pool);
+    std::unordered_map<std::string, const RomIndexEntry*> previous;
+    for (const auto& entry : entries) {
+        previous.emplace(entry.path, &entry);
+    }
+
+    ScanStats stats{files.size(), 0, 0, 0};
+    std::vector<RomIndexEntry> scanned(files.size());
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < files.size(); i++) {
+        auto it = previous.find(files[i].path);
+        if (it != previous.end() && it->second->mtime == files[i].mtime
+            && it->second->file_size == files[i].size) {
+            scanned[i] = *it->second;
+            stats.unchanged++;
+            continue;
+        }
+        scanned[i] = RomIndexEntry{};
+        scanned[i].path = std::move(files[i].path);
+        scanned[i].mtime = files[i].mtime;
+        scanned[i].file_size = files[i].size;
+        changed.push_back(i);
+    }
+    pool.parallel_for(changed.size(), [&](size_t i) {
+        hash_file(scanned[changed[i]]);
+    });
+    stats.hashed = changed.size();
+
+    std::sort(scanned.begin(), scanned.end(),
+              [](const RomIndexEntry& a, const RomIndexEntry& b) { return a.path < b.path; });
+    // A root given twice, or nested in another, finds the same file twice.
+    scanned.erase(std::unique(scanned.begin(), scanned.end(),
+                              [](const RomIndexEntry& a, const RomIndexEntry& b) { return a.path == b.path; }),
+                  scanned.end());
+    stats.files = scanned.size();
+    for (const auto& entry : scanned) {
+        if (!entry.valid) {
+            stats.invalid++;
+        }
+    }
+    entries = std::move(scanned);
+    return stats;
+}
+
+const HeaderFix* RomIndex::find_fix(uint32_t rom_crc32) const {
+    auto it = std::lower_bound(fixes.begin(), fixes.end(), rom_crc32,
+                               [](const HeaderFix& fix, uint32_t crc) { return fix.rom_crc32 < crc; });
+    if (it == fixes.end() || it->rom_crc32 != rom_crc32) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+void RomIndex::set_fix(const HeaderFix& fix) {
+    auto it = std::lower_bound(fixes.begin(), fixes.end(), fix.rom_crc32,
+                               [](const HeaderFix& f, uint32_t crc) { return f.rom_crc32 < crc; });
+    if (it != fixes.end() && it->rom_crc32 == fix.rom_crc32) {
+        *it = fix;
+    } else {
+        fixes.insert(it, fix);
+    }
+}
+
+bool RomIndex::apply_fix(Rom& rom) const {
+    if (fixes.empty()) {
+        return false;
+    }
+    const HeaderFix* fix = find_fix(crc32(rom.chr_rom, crc32(rom.prg_rom)));
+    if (!fix) {
+        return false;
+    }
+    rom.mapper = fix->mapper;
+    rom.submapper = fix->submapper;
+    rom.screen_mirroring = fix->mirroring;
+    rom.battery = fix->battery;
+    return true;
+}
@@ -0,0 +1,154 @@
+#include "rom_index.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void print_usage() {
+    std::cerr << "Usage: nes-rom-index [options] [DIR|FILE...]\n"
+              << "  --index FILE    index to create or update (default roms.idx)\n"
+              << "  --threads N     worker threads (default: all cores)\n"
+              << "  --fixes FILE    merge header fixes from FILE (see below)\n"
+              << "  --list          print every entry after scanning\n"
+              << "\n"
+              << "Rescans only rehash files whose size or modification time changed.\n"
+              << "\n"
+              << "Fix files hold one cart per line: the ROM CRC32 (PRG then CHR, as\n"
+              << "printed by --list), mapper, submapper, mirroring (H, V or 4) and\n"
+              << "battery (0 or 1). Text after '#' is ignored.\n";
+}
+
+Mirroring parse_mirroring(const std::string& text) {
+    if (text == "H" || text == "h") {
+        return Mirroring::Horizontal;
+    }
+    if (text == "V" || text == "v") {
+        return Mirroring::Vertical;
+    }
+    if (text == "4") {
+        return Mirroring::FourScreen;
+    }
+    throw std::runtime_error("Unknown mirroring: " + text);
+}
+
+char mirroring_code(Mirroring mirroring) {
+    switch (mirroring) {
+        case Mirroring::Horizontal: return 'H';
+        case Mirroring::Vertical: return 'V';
+        case Mirroring::FourScreen: return '4';
+        default: return '1';
+    }
+}
+
+size_t read_fixes(const std::string& path, RomIndex& index) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    size_t count = 0;
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string crc, mirroring;
+        unsigned mapper, submapper, battery;
+        if (!(fields >> crc)) {
+            continue;
+        }
+        if (!(fields >> mapper >> submapper >> mirroring >> battery) || mapper > 0xFFF || submapper > 0xF) {
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": malformed fix");
+        }
+        HeaderFix fix;
+        fix.rom_crc32 = static_cast<uint32_t>(std::stoul(crc, nullptr, 16));
+        fix.mapper = static_cast<uint16_t>(mapper);
+        fix.submapper = static_cast<uint8_t>(submapper);
+        fix.mirroring = parse_mirroring(mirroring);
+        fix.battery = battery != 0;
+        index.set_fix(fix);
+        count++;
+    }
+    return count;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string index_path = "roms.idx";
+    std::string fixes_path;
+    std::vector<std::string> roots;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool list = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--index" && i + 1 < argc) {
+            index_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--fixes" && i + 1 < argc) {
+            fixes_path = argv[++i];
+        } else if (arg == "--list") {
+            list = true;
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            roots.push_back(arg);
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (roots.empty() && fixes_path.empty() && !list) {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        RomIndex index;
+        if (std::filesystem::exists(index_path)) {
+            index = RomIndex::load(index_path);
+        }
+        bool changed = false;
+        if (!fixes_path.empty()) {
+            size_t count = read_fixes(fixes_path, index);
+            std::cout << count << " header fixes merged\n";
+            changed = true;
+        }
+        if (!roots.empty()) {
+            ThreadPool pool(threads);
+            auto start = std::chrono::steady_clock::now();
+            ScanStats stats = index.scan(roots, pool);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << stats.files << " files (" << stats.hashed << " hashed, " << stats.unchanged
+                      << " unchanged, " << stats.invalid << " invalid) in " << seconds << " s\n";
+            changed = true;
+        }
+        if (changed) {
+            index.save(index_path);
+        }
+        if (list) {
+            for (const auto& entry : index.entries) {
+                if (!entry.valid) {
+                    std::printf("%-8s %s\n", "invalid", entry.path.c_str());
+                    continue;
+                }
+                std::printf("%08X %s mapper %3u.%u %c%s %4uK/%4uK %s\n", entry.rom_crc32,
+                            to_hex(entry.rom_sha1).c_str(), entry.mapper, entry.submapper,
+                            mirroring_code(entry.mirroring), entry.battery ? "B" : " ",
+                            entry.prg_size / 1024, entry.chr_size / 1024, entry.path.c_str());
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
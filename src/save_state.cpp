@@ -0,0 +1,132 @@
+#include "save_state.h"
+
+namespace {
+
+// Header: magic, format version. Chunk header: tag, version, reserved, length.
+const size_t HEADER_SIZE = 8;
+const size_t CHUNK_HEADER_SIZE = 12;
+
+uint32_t load_u32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint16_t load_u16(const uint8_t* p) {
+    uint16_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+}
+
+StateWriter::StateWriter()
+    : buffer()
+    , counting(true)
+    , pos(0)
+    , chunk_start(0)
+{
+    write_bytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+    write(STATE_FORMAT_VERSION);
+}
+
+StateWriter::StateWriter(std::span<uint8_t> buffer)
+    : buffer(buffer)
+    , counting(false)
+    , pos(0)
+    , chunk_start(0)
+{
+    write_bytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+    write(STATE_FORMAT_VERSION);
+}
+
+void StateWriter::write_bytes(const void* data, size_t size) {
+    if (!counting && size > 0) {
+        if (size > buffer.size() - pos) {
+            throw StateError("Save state buffer is too small");
+        }
+        std::memcpy(buffer.data() + pos, data, size);
+    }
+    pos += size;
+}
+
+void StateWriter::begin_chunk(const char (&tag)[5], uint16_t version) {
+    chunk_start = pos;
+    write_bytes(tag, 4);
+    write(version);
+    write(uint16_t{0});
+    write(uint32_t{0});
+}
+
+void StateWriter::end_chunk() {
+    if (!counting) {
+        uint32_t length = static_cast<uint32_t>(pos - chunk_start - CHUNK_HEADER_SIZE);
+        std::memcpy(buffer.data() + chunk_start + 8, &length, sizeof(length));
+    }
+}
+
+StateReader::StateReader(std::span<const uint8_t> buffer)
+    : buffer(buffer)
+    , pos(0)
+    , chunk_end(0)
+    , chunk_tag(nullptr)
+{
+    if (buffer.size() < HEADER_SIZE || std::memcmp(buffer.data(), STATE_MAGIC, sizeof(STATE_MAGIC)) != 0) {
+        throw StateError("Not a save state");
+    }
+    if (load_u32(buffer.data() + 4) != STATE_FORMAT_VERSION) {
+        throw StateError("Unsupported save state version");
+    }
+    size_t at = HEADER_SIZE;
+    while (at < buffer.size()) {
+        if (buffer.size() - at < CHUNK_HEADER_SIZE) {
+            throw StateError("Save state is truncated");
+        }
+        size_t length = load_u32(buffer.data() + at + 8);
+        if (length > buffer.size() - at - CHUNK_HEADER_SIZE) {
+            throw StateError("Save state is truncated");
+        }
+        at += CHUNK_HEADER_SIZE + length;
+    }
+}
+
+uint16_t StateReader::open_chunk(const char (&tag)[5]) {
+    size_t at = HEADER_SIZE;
+    while (at < buffer.size()) {
+        size_t length = load_u32(buffer.data() + at + 8);
+        if (std::memcmp(buffer.data() + at, tag, 4) == 0) {
+            pos = at + CHUNK_HEADER_SIZE;
+            chunk_end = pos + length;
+            chunk_tag = tag;
+            return load_u16(buffer.data() + at + 4);
+        }
+        at += CHUNK_HEADER_SIZE + length;
+    }
+    throw StateError(std::string("Save state has no ") + tag + " chunk");
+}
+
+void StateReader::read_bytes(void* data, size_t size) {
+    if (size > chunk_end - pos) {
+        throw StateError(std::string("Save state ") + (chunk_tag ? chunk_tag : "header") + " chunk is too short");
+    }
+    if (size == 0) {
+        return;
+    }
+    std::memcpy(data, buffer.data() + pos, size);
+    pos += size;
+}
+
+std::span<const uint8_t> StateReader::read_view(size_t size) {
+    if (size > chunk_end - pos) {
+        throw StateError(std::string("Save state ") + (chunk_tag ? chunk_tag : "header") + " chunk is too short");
+    }
+    std::span<const uint8_t> view = buffer.subspan(pos, size);
+    pos += size;
+    return view;
+}
+
+void StateReader::close_chunk() {
+    if (pos != chunk_end) {
+        throw StateError(std::string("Save state ") + chunk_tag + " chunk is too long");
+    }
+}
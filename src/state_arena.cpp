@@ -0,0 +1,24 @@
+#include "state_arena.h"
+#include <cstring>
+
+StateArena::StateArena(std::initializer_list<size_t> block_sizes)
+    : memory(nullptr)
+    , length(0)
+    , offsets{}
+    , sizes{}
+{
+    if (block_sizes.size() > MAX_BLOCKS) {
+        throw std::logic_error("Too many state arena blocks");
+    }
+    size_t index = 0;
+    for (size_t size : block_sizes) {
+        offsets[index] = length;
+        sizes[index] = size;
+        length += (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        index++;
+    }
+    // Keep the allocation non-empty so every block has a valid address.
+    size_t allocation = length ? length : ALIGNMENT;
+    memory.reset(static_cast<uint8_t*>(::operator new[](allocation, std::align_val_t(ALIGNMENT))));
+    std::memset(memory.get(), 0, allocation);
+}
@@ -0,0 +1,74 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t threads)
+    : job(nullptr)
+    , job_count(0)
+    , next_index(0)
+    , busy_workers(0)
+    , generation(0)
+    , stopping(false)
+{
+    for (size_t i = 1; i < threads; i++) {
+        workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run_jobs() {
+    size_t i;
+    while ((i = next_index.fetch_add(1)) < job_count) {
+        (*job)(i);
+    }
+}
+
+void ThreadPool::worker_loop() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        lock.unlock();
+        run_jobs();
+        lock.lock();
+        if (--busy_workers == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+// The calling thread takes work too, so a pool of size 1 has no workers
+// and simply runs the loop inline.
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        job_count = count;
+        next_index = 0;
+        busy_workers = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    run_jobs();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busy_workers == 0; });
+    job = nullptr;
+}
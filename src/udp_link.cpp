@@ -0,0 +1,152 @@
+#include "udp_link.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+UdpLink::UdpLink(uint16_t local_port)
+    : fd(-1)
+    , port(0)
+    , peer_ip(0)
+    , peer_port(0)
+    , latency_ms(0.0)
+    , jitter_ms(0.0)
+    , loss(0.0)
+    , random(0)
+    , delayed()
+    , sent(0)
+    , dropped(0)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Could not create UDP socket: ") + std::strerror(errno));
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(local_port);
+    socklen_t length = sizeof(address);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) < 0
+        || ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Could not bind UDP port " + std::to_string(local_port) + ": " + error);
+    }
+    port = ntohs(address.sin_port);
+#else
+    (void)local_port;
+    throw std::runtime_error("Netplay is not supported on this platform");
+#endif
+}
+
+UdpLink::~UdpLink() {
+#if defined(__unix__) || defined(__APPLE__)
+    ::close(fd);
+#endif
+}
+
+void UdpLink::connect(const std::string& address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::invalid_argument("Peer address must be host:port: " + address);
+    }
+    connect(address.substr(0, colon), static_cast<uint16_t>(std::stoul(address.substr(colon + 1))));
+}
+
+void UdpLink::simulate(double latency, double jitter, double loss_rate, uint32_t seed) {
+    latency_ms = latency;
+    jitter_ms = jitter;
+    loss = loss_rate;
+    random.seed(seed);
+}
+
+void UdpLink::send(std::span<const uint8_t> packet) {
+    if (peer_port == 0) {
+        throw std::logic_error("UDP link has no peer");
+    }
+    if (loss > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < loss) {
+        dropped++;
+        return;
+    }
+    if (latency_ms <= 0.0 && jitter_ms <= 0.0) {
+        transmit(packet);
+        return;
+    }
+    double delay = latency_ms + std::uniform_real_distribution<double>(0.0, jitter_ms)(random);
+    Delayed entry;
+    entry.due = std::chrono::steady_clock::now()
+              + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::milli>(delay));
+    entry.bytes.assign(packet.begin(), packet.end());
+    // Jitter can reorder packets, as on a real network.
+    auto at = std::upper_bound(delayed.begin(), delayed.end(), entry.due,
+                               [](auto due, const Delayed& d) { return due < d.due; });
+    delayed.insert(at, std::move(entry));
+}
+
+void UdpLink::flush() {
+    auto now = std::chrono::steady_clock::now();
+    while (!delayed.empty() && delayed.front().due <= now) {
+        transmit(delayed.front().bytes);
+        delayed.pop_front();
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+void UdpLink::connect(const std::string& host, uint16_t remote_port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (::getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        throw std::runtime_error("Could not resolve " + host);
+    }
+    peer_ip = ntohl(reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr.s_addr);
+    peer_port = remote_port;
+    ::freeaddrinfo(result);
+}
+
+void UdpLink::transmit(std::span<const uint8_t> packet) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(peer_ip);
+    address.sin_port = htons(peer_port);
+    // A full socket buffer is just another lost packet.
+    ::sendto(fd, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    sent++;
+}
+
+size_t UdpLink::receive(std::span<uint8_t> buffer) {
+    flush();
+    while (true) {
+        sockaddr_in from{};
+        socklen_t length = sizeof(from);
+        ssize_t size = ::recvfrom(fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&from), &length);
+        if (size <= 0) {
+            return 0;
+        }
+        if (ntohl(from.sin_addr.s_addr) == peer_ip && ntohs(from.sin_port) == peer_port) {
+            return static_cast<size_t>(size);
+        }
+    }
+}
+
+#else
+
+// Unreachable: the constructor already refused to build a link.
+void UdpLink::connect(const std::string&, uint16_t) {}
+void UdpLink::transmit(std::span<const uint8_t>) {}
+size_t UdpLink::receive(std::span<uint8_t>) { return 0; }
+
+#endif
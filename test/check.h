@@ -0,0 +1,65 @@
+#ifndef CHECK_H
+#define CHECK_H
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Shared scaffolding for the test executables. A test calls check() for
+// every expectation and returns finish() from main, which fails the run
+// if any check did.
+
+inline int failures = 0;
+
+inline void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << "\n";
+        failures++;
+    }
+}
+
+inline int finish(const std::string& name) {
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << name << " tests passed\n";
+    return 0;
+}
+
+// True if f throws E. Any other exception is reported and counts as false.
+template<typename E, typename F>
+bool throws(F&& f) {
+    try {
+        f();
+    } catch (const E&) {
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "  unexpected exception: " << e.what() << "\n";
+    }
+    return false;
+}
+
+inline std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+inline void write_file(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// A scratch file in the system temp directory.
+inline std::string temp_path(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("nes-emu-test-" + name)).string();
+}
+
+#endif // CHECK_H
@@ -0,0 +1,119 @@
+#include "check.h"
+#include "movie.h"
+#include "joypad.h"
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Usage: movie-test path/to/buttons.fm2
+
+namespace {
+
+void test_round_trip() {
+    std::mt19937 rng(1);
+    Movie movie;
+    movie.rom_crc32 = 0xDEADBEEF;
+    // Long held runs, as in play, mixed with frames that all differ.
+    for (int i = 0; i < 2000; i++) {
+        MovieFrame frame = {{static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng())}, 0};
+        if (rng() % 50 == 0) {
+            frame.commands = rng() % 2 ? MOVIE_RESET : MOVIE_POWER;
+        }
+        movie.frames.insert(movie.frames.end(), rng() % 3 == 0 ? 1 + rng() % 300 : 1, frame);
+    }
+    std::string path = temp_path("movie-round-trip.mov");
+    movie.save(path);
+    Movie loaded = Movie::load(path);
+    check(loaded.rom_crc32 == movie.rom_crc32, "round trip keeps the ROM CRC");
+    check(loaded.frames == movie.frames, "round trip keeps every frame");
+
+    Movie empty;
+    empty.save(path);
+    check(Movie::load(path).frames.empty(), "an empty movie round-trips");
+
+    movie.save(path);
+    std::vector<uint8_t> bytes = read_file(path);
+    for (size_t cut : {bytes.size() - 1, bytes.size() / 2, size_t{20}, size_t{13}}) {
+        write_file(path, std::vector<uint8_t>(bytes.begin(), bytes.begin() + cut));
+        check(throws<std::runtime_error>([&] { Movie::load(path); }),
+              "a movie cut to " + std::to_string(cut) + " bytes is rejected");
+    }
+    std::vector<uint8_t> trailing = bytes;
+    trailing.push_back(0);
+    write_file(path, trailing);
+    check(throws<std::runtime_error>([&] { Movie::load(path); }), "trailing bytes are rejected");
+    std::remove(path.c_str());
+}
+
+// A 28-byte file whose single run claims 2^32-1 frames must be refused
+// from its header, not after allocating 12 GB for it.
+void test_huge_frame_count() {
+    std::vector<uint8_t> bytes = {'N', 'E', 'S', 'M', 'O', 'V', 0, 0,
+                                  1, 0, 0, 0,
+                                  0, 0, 0, 0,
+                                  0xFF, 0xFF, 0xFF, 0xFF,
+                                  0xFF, 0xFF, 0xFF, 0xFF, 0x0F,
+                                  0, 0, 0};
+    std::string path = temp_path("movie-huge.mov");
+    write_file(path, bytes);
+    check(throws<std::runtime_error>([&] { Movie::load(path); }), "a huge frame count is rejected");
+
+    // The same with a count that passes the length limit but runs that
+    // do not add up to it.
+    bytes[16] = 100;
+    bytes[17] = bytes[18] = bytes[19] = 0;
+    bytes[20] = 10;
+    bytes.resize(24);
+    write_file(path, bytes);
+    check(throws<std::runtime_error>([&] { Movie::load(path); }), "runs short of the frame count are rejected");
+    std::remove(path.c_str());
+}
+
+void test_fm2(const std::string& fixture) {
+    Movie movie = Movie::load(fixture);
+    check(movie.rom_crc32 == 0, "FM2 movies play on any ROM");
+    const uint8_t order[8] = {RIGHT, LEFT, DOWN, UP, START, SELECT, BUTTON_B, BUTTON_A};
+    if (movie.frames.size() != 12) {
+        check(false, "FM2 fixture has 12 frames, got " + std::to_string(movie.frames.size()));
+        return;
+    }
+    check(movie.frames[0] == MovieFrame{{0, 0}, 0}, "FM2 '.' means released");
+    // Frames 1-8 walk one button along "RLDUTSBA" on port 0 and the other
+    // way on port 1.
+    for (size_t i = 0; i < 8; i++) {
+        const MovieFrame& frame = movie.frames[1 + i];
+        check(frame.pads[0] == order[i], "FM2 port 0 column " + std::to_string(i));
+        check(frame.pads[1] == order[7 - i], "FM2 port 1 column " + std::to_string(7 - i));
+        check(frame.commands == 0, "FM2 frame without commands");
+    }
+    check(movie.frames[9] == MovieFrame{{0xFF, 0}, MOVIE_RESET}, "FM2 command 1 is a reset");
+    check(movie.frames[10] == MovieFrame{{0, 0xFF}, MOVIE_POWER}, "FM2 command 2 is a power cycle");
+    check(movie.frames[11].commands == (MOVIE_RESET | MOVIE_POWER), "FM2 commands combine");
+
+    check(throws<std::runtime_error>([] { Movie::parse_fm2("|0|........|........||\n"); }),
+          "FM2 input before the header is rejected");
+    check(throws<std::runtime_error>([] { Movie::parse_fm2("version 3\n|0|RLDU|........||\n"); }),
+          "FM2 short gamepad fields are rejected");
+    check(Movie::parse_fm2("version 3\r\n|0|R......A|........||\r\n").frames.at(0).pads[0]
+              == (RIGHT | BUTTON_A), "FM2 with CRLF line ends");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " buttons.fm2\n";
+        return 2;
+    }
+    try {
+        test_round_trip();
+        test_huge_frame_count();
+        test_fm2(argv[1]);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return finish("movie");
+}
@@ -20,11 +20,11 @@ std::vector<uint8_t> read_file(const std::string& filename) {
     return buffer;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "Hello from C++ NES Emulator!" << std::endl;
     try {
         std::cout << "Loading nestest.nes...\n";
-        std::vector<uint8_t> rom_data = read_file("../test/roms/nestest.nes");
+        std::vector<uint8_t> rom_data = read_file(argc > 1 ? argv[1] : "../test/roms/nestest.nes");
         Rom rom = Rom::create(rom_data);
         std::cout << "ROM loaded successfully!\n";
         std::cout << "  PRG-ROM: " << rom.prg_rom.size() << " bytes\n";
@@ -45,27 +45,36 @@ int main() {
         std::cout << "CPU reset complete!\n";
         std::cout << "  Program Counter: 0x" << std::hex << cpu.program_counter << std::dec << "\n\n";
         
+        // Started at $C000, nestest runs every test without a PPU and ends
+        // with an RTS at $C66E, leaving the number of the first failed
+        // official test in $02 and unofficial test in $03, or zero when
+        // everything passed.
         std::cout << "Running CPU with trace output:\n";
         std::cout << "=================================\n";
+        const uint16_t END_PC = 0xC66E;
+        const int INSTRUCTION_LIMIT = 10000;
         int instruction_count = 0;
         bool printed_vblank = false;
         cpu.run_with_callback([&instruction_count, &printed_vblank](CPU& cpu) {
             if (instruction_count < 50 || (instruction_count >= 200 && instruction_count < 300)) {
                 std::cout << trace(cpu) << "\n";
             }
-            if (!printed_vblank && cpu.bus.ppu->status.is_in_vblank()) {
-                std::cout << "\n*** VBlank Started! Scanline=" << cpu.bus.ppu->scanline << " ***\n\n";
+            if (!printed_vblank && cpu.bus.ppu.status.is_in_vblank()) {
+                std::cout << "\n*** VBlank Started! Scanline=" << cpu.bus.ppu.scanline << " ***\n\n";
                 printed_vblank = true;
             }
-            instruction_count++;
-            
-            if (instruction_count >= 500) {
-                std::cout << "\nReached 500 instructions. Final state:\n";
-                std::cout << "  Scanline: " << cpu.bus.ppu->scanline << "\n";
-                std::cout << "  VBlank: " << (cpu.bus.ppu->status.is_in_vblank() ? "YES" : "NO") << "\n";
-                std::cout << "  PC: 0x" << std::hex << cpu.program_counter << std::dec << "\n";
-                std::exit(0); 
+            if (cpu.program_counter == END_PC || instruction_count >= INSTRUCTION_LIMIT) {
+                uint8_t official = cpu.mem_read(0x02);
+                uint8_t unofficial = cpu.mem_read(0x03);
+                std::cout << "\nStopped after " << instruction_count << " instructions at PC 0x"
+                          << std::hex << cpu.program_counter
+                          << ": $02=0x" << static_cast<int>(official)
+                          << " $03=0x" << static_cast<int>(unofficial) << std::dec << "\n";
+                bool passed = cpu.program_counter == END_PC && official == 0 && unofficial == 0;
+                std::cout << (passed ? "nestest passed" : "nestest FAILED") << std::endl;
+                std::exit(passed ? 0 : 1);
             }
+            instruction_count++;
         });
         
     } catch (const std::exception& e) {
@@ -0,0 +1,89 @@
+#include "check.h"
+#include "rewind_buffer.h"
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Changes a few short runs of the state, like a frame does, and now and
+// then most of it, so deltas vary from a few bytes to the worst case.
+void mutate(std::vector<uint8_t>& state, std::mt19937& rng) {
+    std::uniform_int_distribution<size_t> pos(0, state.size() - 1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    int runs = rng() % 16 == 0 ? static_cast<int>(state.size()) : static_cast<int>(rng() % 6);
+    for (int i = 0; i < runs; i++) {
+        size_t at = pos(rng);
+        size_t length = 1 + rng() % 8;
+        for (size_t j = at; j < at + length && j < state.size(); j++) {
+            state[j] = static_cast<uint8_t>(byte(rng));
+        }
+    }
+}
+
+// Pushes and pops at random against a plain list of the states. The ring
+// is as small as the buffer allows (one worst-case delta), so deltas keep
+// wrapping past its end and old ones are dropped all the time.
+void test_against_model(size_t state_size, size_t max_states, uint32_t seed) {
+    std::mt19937 rng(seed);
+    RewindBuffer buffer(state_size, max_states, 1);
+    std::deque<std::vector<uint8_t>> model;
+    std::vector<uint8_t> state(state_size);
+    std::vector<uint8_t> popped(state_size);
+    size_t pushes = 0;
+    std::string name = "seed " + std::to_string(seed) + ": ";
+
+    for (int step = 0; step < 20000; step++) {
+        if (rng() % 4 != 0) {
+            mutate(state, rng);
+            buffer.push(state);
+            model.push_back(state);
+            pushes++;
+            // Whatever was dropped must have been the oldest.
+            check(buffer.size() >= 1 && buffer.size() <= model.size(), name + "size after push");
+            while (model.size() > buffer.size()) {
+                model.pop_front();
+            }
+            check(buffer.size() <= max_states, name + "never more than max_states");
+        } else {
+            bool ok = buffer.pop(popped);
+            check(ok == !model.empty(), name + "pop fails only when empty");
+            if (ok) {
+                check(popped == model.back(), name + "pop returns the newest state");
+                state = model.back();
+                model.pop_back();
+            }
+            check(buffer.size() == model.size(), name + "size after pop");
+        }
+    }
+    check(model.size() < pushes, name + "old states were evicted");
+
+    // Everything left comes back newest first.
+    while (!model.empty()) {
+        check(buffer.pop(popped) && popped == model.back(), name + "draining returns states in order");
+        model.pop_back();
+    }
+    check(!buffer.pop(popped), name + "empty after draining");
+    check(buffer.bytes_used() == 0, name + "no delta bytes left");
+}
+
+void test_clear() {
+    RewindBuffer buffer(16, 8, 1);
+    std::vector<uint8_t> state(16, 1);
+    buffer.push(state);
+    buffer.push(state);
+    buffer.clear();
+    check(buffer.size() == 0 && !buffer.pop(state), "clear empties the history");
+}
+
+}
+
+int main() {
+    test_against_model(64, 1000, 1);
+    test_against_model(64, 1000, 2);
+    test_against_model(200, 12, 3);
+    test_against_model(1, 3, 4);
+    test_clear();
+    return finish("rewind buffer");
+}
@@ -0,0 +1,118 @@
+#include "check.h"
+#include "emulator.h"
+#include "save_state.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Usage: save-state-test path/to/nestest.nes
+
+namespace {
+
+// Offsets of the chunk headers, following the layout in save_state.cpp:
+// an 8-byte header, then per chunk a tag, version, reserved and length.
+std::vector<size_t> chunk_offsets(const std::vector<uint8_t>& state) {
+    std::vector<size_t> offsets;
+    size_t at = 8;
+    while (at + 12 <= state.size()) {
+        offsets.push_back(at);
+        uint32_t length;
+        std::memcpy(&length, &state[at + 8], sizeof(length));
+        at += 12 + length;
+    }
+    return offsets;
+}
+
+void test_round_trip(Emulator& emulator, const std::vector<uint8_t>& rom) {
+    std::vector<uint8_t> first(emulator.state_size());
+    std::vector<uint8_t> second(emulator.state_size());
+    check(emulator.save_state(first) == first.size(), "save_state fills state_size() bytes");
+
+    // A fresh machine, so nothing carries over from the original.
+    Emulator copy;
+    copy.load_rom(rom);
+    copy.load_state(first);
+    copy.save_state(second);
+    check(first == second, "save -> load -> save gives identical bytes");
+
+    emulator.run_frame();
+    copy.run_frame();
+    emulator.save_state(first);
+    copy.save_state(second);
+    check(first == second, "a loaded machine runs on like the original");
+}
+
+void test_chunk_versions(Emulator& emulator) {
+    std::vector<uint8_t> state(emulator.state_size());
+    emulator.save_state(state);
+    std::vector<size_t> offsets = chunk_offsets(state);
+    check(offsets.size() >= 6, "state has a chunk per component");
+    for (size_t at : offsets) {
+        std::string tag(state.begin() + at, state.begin() + at + 4);
+        for (uint16_t version : {uint16_t{0}, uint16_t{0xFFFF}}) {
+            std::vector<uint8_t> damaged = state;
+            std::memcpy(&damaged[at + 4], &version, sizeof(version));
+            check(throws<StateError>([&] { emulator.load_state(damaged); }),
+                  tag + " chunk version " + std::to_string(version) + " is rejected");
+        }
+    }
+
+    std::vector<uint8_t> future = state;
+    future[4]++;
+    check(throws<StateError>([&] { emulator.load_state(future); }), "a newer format version is rejected");
+
+    // A chunk a later build might add is skipped rather than misread.
+    std::vector<uint8_t> extended(state.size() + 16);
+    StateWriter out(extended);
+    out.begin_chunk("NEW ", 1);
+    out.write(uint32_t{0x12345678});
+    out.end_chunk();
+    std::copy(state.begin() + 8, state.end(), extended.begin() + out.size());
+    emulator.load_state(extended);
+    std::vector<uint8_t> again(state.size());
+    emulator.save_state(again);
+    check(again == state, "unknown chunks are ignored");
+}
+
+void test_truncated(Emulator& emulator) {
+    std::vector<uint8_t> state(emulator.state_size());
+    emulator.save_state(state);
+    std::vector<size_t> cuts = {0, 4, 7, 8, 12, state.size() / 2, state.size() - 1};
+    for (size_t at : chunk_offsets(state)) {
+        cuts.push_back(at);
+        cuts.push_back(at + 6);
+    }
+    for (size_t cut : cuts) {
+        std::span<const uint8_t> truncated(state.data(), cut);
+        check(throws<StateError>([&] { emulator.load_state(truncated); }),
+              "a state cut to " + std::to_string(cut) + " bytes is rejected");
+    }
+
+    std::vector<uint8_t> small(state.size() - 1);
+    check(throws<StateError>([&] { emulator.save_state(small); }), "saving into a short buffer is rejected");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " nestest.nes\n";
+        return 2;
+    }
+    try {
+        std::vector<uint8_t> rom = read_file(argv[1]);
+        Emulator emulator;
+        emulator.load_rom(rom);
+        for (int i = 0; i < 30; i++) {
+            emulator.run_frame();
+        }
+        test_round_trip(emulator, rom);
+        test_chunk_versions(emulator);
+        test_truncated(emulator);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return finish("save state");
+}